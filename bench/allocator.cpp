@@ -0,0 +1,100 @@
+#include <si/vk_renderer.hpp>
+#include <si/vk_allocator.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <tuple>
+#include <cstdint>
+
+// Making and freeing many small buffers through the sub-allocator, against
+// giving each a vkAllocateMemory of its own, as make_buffer used to.
+namespace {
+    using clock = std::chrono::steady_clock;
+    constexpr ::vk::DeviceSize buffer_size = 4096;
+    constexpr int rounds = 5;
+    const ::vk::BufferUsageFlags usage = ::vk::BufferUsageFlagBits::eVertexBuffer | ::vk::BufferUsageFlagBits::eTransferDst;
+
+    struct dedicated_buffer {
+        ::vk::UniqueDeviceMemory memory; // outlives the buffer bound to it
+        ::vk::UniqueBuffer buffer;
+    };
+    dedicated_buffer make_dedicated(si::vk::gfx_device& gfx) {
+        ::vk::UniqueBuffer buffer = gfx.logical->createBufferUnique (
+            ::vk::BufferCreateInfo {
+                .flags = {},
+                .size = buffer_size,
+                .usage = usage,
+                .sharingMode = ::vk::SharingMode::eExclusive,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr
+            }
+        );
+        const ::vk::MemoryRequirements reqs = gfx.logical->getBufferMemoryRequirements(*buffer);
+        ::vk::UniqueDeviceMemory memory = gfx.logical->allocateMemoryUnique (
+            ::vk::MemoryAllocateInfo {
+                .allocationSize = reqs.size,
+                .memoryTypeIndex = gfx.find_memory_type_index(reqs, ::vk::MemoryPropertyFlagBits::eDeviceLocal)
+            }
+        );
+        gfx.logical->bindBufferMemory(*buffer, *memory, 0);
+        return dedicated_buffer { std::move(memory), std::move(buffer) };
+    }
+    double us_since(clock::time_point start, std::size_t count) {
+        return std::chrono::duration<double, std::micro>(clock::now() - start).count() / count;
+    }
+    // Best of a few rounds of making count buffers then freeing them all
+    template <typename Make>
+    std::tuple<double, double> time_buffers(std::size_t count, Make&& make) {
+        double best_make = 1e30;
+        double best_free = 1e30;
+        for (int round = 0; round < rounds; round++) {
+            std::vector<decltype(make())> buffers;
+            buffers.reserve(count);
+            const auto made = clock::now();
+            for (std::size_t i = 0; i < count; i++) {
+                buffers.push_back(make());
+            }
+            best_make = std::min(best_make, us_since(made, count));
+            const auto freed = clock::now();
+            buffers.clear();
+            best_free = std::min(best_free, us_since(freed, count));
+        }
+        return {best_make, best_free};
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    si::vk::root vk;
+    si::vk::gfx_device& gfx = vk.get_device(nullptr);
+    // The dedicated path has to stay well under the driver's allocation limit
+    const std::size_t count = std::min<std::size_t>(4000, gfx.physical.getProperties().limits.maxMemoryAllocationCount / 2);
+
+    const auto [sub_make, sub_free] = time_buffers(count, [&]() {
+        return gfx.make_buffer(buffer_size, usage, ::vk::SharingMode::eExclusive, ::vk::MemoryPropertyFlagBits::eDeviceLocal);
+    });
+    const auto [dedicated_make, dedicated_free] = time_buffers(count, [&]() {
+        return make_dedicated(gfx);
+    });
+    fmt::print("{} buffers of {} bytes\n", count, buffer_size);
+    fmt::print("sub-allocated: {:.2f} us to make, {:.2f} us to free per buffer\n", sub_make, sub_free);
+    fmt::print("dedicated:     {:.2f} us to make, {:.2f} us to free per buffer\n", dedicated_make, dedicated_free);
+
+    // Fragmentation with every other buffer freed, the worst case for a buddy allocator
+    std::vector<std::tuple<::vk::UniqueBuffer, si::vk::allocation>> kept;
+    for (std::size_t i = 0; i < count; i++) {
+        kept.push_back(gfx.make_buffer(buffer_size, usage, ::vk::SharingMode::eExclusive, ::vk::MemoryPropertyFlagBits::eDeviceLocal));
+    }
+    for (std::size_t i = 0; i < kept.size(); i += 2) {
+        std::get<0>(kept[i]).reset();
+        std::get<1>(kept[i]).reset();
+    }
+    const si::vk::allocator_stats stats = gfx.allocator->stats();
+    fmt::print (
+        "half freed: {} sub-allocations in {} device allocations, {:.0f}% internal / {:.0f}% external fragmentation\n",
+        stats.live_allocations, stats.device_allocations, stats.internal_fragmentation * 100.0, stats.external_fragmentation * 100.0
+    );
+    return 0;
+}
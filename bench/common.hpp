@@ -0,0 +1,51 @@
+#ifndef SI_BENCH_COMMON_HPP_INCLUDED
+#define SI_BENCH_COMMON_HPP_INCLUDED
+
+#include <si/ui.hpp>
+#include <chrono>
+#include <cstdint>
+
+// The scene and timing the renderer benchmarks share, so their numbers
+// compare: rects of mixed sizes spread over the screen, translucent, a
+// quarter of them bordered, and shifted a little each frame.
+namespace si {
+    namespace bench {
+        inline si::rect scene_rect(std::uint32_t i, std::uint32_t frame, std::uint32_t width, std::uint32_t height) {
+            const std::uint32_t seed = (i + frame) * 2654435761u;
+            return si::rect {
+                .x = static_cast<float>(i * 37 % width),
+                .y = static_cast<float>(i * 53 % height),
+                .width = static_cast<float>(8 + seed % 56),
+                .height = static_cast<float>(8 + (seed >> 8) % 24),
+                .colour = 0xc0000000 | (seed & 0xffffff),
+                .border_colour = 0xff000000,
+                .border_width = i % 4 == 0 ? 1.0f : 0.0f
+            };
+        }
+        // Replaces r's scene with count rects as they are at frame
+        template <typename Renderer>
+        void add_scene(Renderer& r, std::uint32_t count, std::uint32_t frame, std::uint32_t width, std::uint32_t height) {
+            r.clear();
+            for (std::uint32_t i = 0; i < count; i++) {
+                r.add_rect(scene_rect(i, frame, width, height));
+            }
+        }
+        // Milliseconds per frame of draw(frame) over timed frames, after
+        // warmup ones; finish() waits for drawing to complete, e.g. on the GPU
+        template <typename Draw, typename Finish>
+        double ms_per_frame(int warmup, int timed, Draw&& draw, Finish&& finish) {
+            for (int i = 0; i < warmup; i++) {
+                draw(i);
+            }
+            finish();
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < timed; i++) {
+                draw(i);
+            }
+            finish();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / timed;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,38 @@
+#include "common.hpp"
+#include <si/vk_renderer.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <cstdint>
+
+// Frame time of a headless renderer with 1, 2 and 3 frames in flight. The
+// scene is big enough that recording a frame costs about as much as drawing
+// it, which is where overlapping the CPU with the GPU pays off.
+namespace {
+    constexpr std::uint32_t width = 1920;
+    constexpr std::uint32_t height = 1080;
+    constexpr std::uint32_t rect_count = 20000;
+
+    double ms_per_frame(si::vk::root& vk, std::uint32_t frames_in_flight) {
+        auto r = vk.make_headless_renderer(width, height, false, frames_in_flight);
+        si::bench::add_scene(*r, rect_count, 0, width, height);
+        // Pipelines, instance buffers and startup uploads are made by the first frames
+        return si::bench::ms_per_frame (
+            10, 300,
+            [&](int) {
+                r->invalidate();
+                r->draw();
+            },
+            [&]() { r->device.logical->waitIdle(); }
+        );
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    si::vk::root vk;
+    for (std::uint32_t frames_in_flight : {1u, 2u, 3u}) {
+        const double ms = ms_per_frame(vk, frames_in_flight);
+        fmt::print("{} frame(s) in flight: {:.3f} ms/frame, {:.1f} frames/s\n", frames_in_flight, ms, 1000.0 / ms);
+    }
+    return 0;
+}
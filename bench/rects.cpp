@@ -0,0 +1,31 @@
+#include "common.hpp"
+#include <si/vk_renderer.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <cstdint>
+
+// Rects per millisecond through the instanced batch on a headless renderer,
+// with the scene rebuilt every frame as a live dashboard's would be. The
+// time covers adding the rects, recording, and the GPU drawing them.
+namespace {
+    constexpr std::uint32_t width = 1920;
+    constexpr std::uint32_t height = 1080;
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    si::vk::root vk;
+    auto r = vk.make_headless_renderer(width, height);
+    for (std::uint32_t count : {1000u, 10000u, 50000u}) {
+        const double ms = si::bench::ms_per_frame (
+            10, 100,
+            [&](int frame) {
+                si::bench::add_scene(*r, count, frame, width, height);
+                r->draw();
+            },
+            [&]() { r->device.logical->waitIdle(); }
+        );
+        fmt::print("{} rects: {:.3f} ms/frame, {:.0f} rects/ms\n", count, ms, count / ms);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <si/sw_raster.hpp>
+#include <fmt/format.h>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+// Megapixels per second each span kernel this CPU runs fills, blends and
+// masks across a 1080p target, a full screen row at a time.
+namespace {
+    constexpr std::int32_t width = 1920;
+    constexpr std::int32_t height = 1080;
+    constexpr int rounds = 20;
+
+    template <typename Op>
+    double megapixels_per_second(Op&& op) {
+        op(); // fault the pages in and warm the caches
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            op();
+        }
+        const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return double(width) * height * rounds / s / 1e6;
+    }
+}
+
+int main() {
+    std::vector<std::uint32_t> pixels(std::size_t(width) * height, 0xff202020);
+    const si::sw::target t { pixels.data(), width, height, width };
+    const si::sw::box screen { 0, 0, width, height };
+    si::sw::image source { width, height, std::vector<std::uint32_t>(std::size_t(width) * height) };
+    for (std::size_t i = 0; i < source.pixels.size(); i++) {
+        source.pixels[i] = si::sw::premultiply(0x80000000 | (std::uint32_t(i) * 2654435761u & 0xffffff));
+    }
+    std::vector<std::uint8_t> coverage(std::size_t(width) * height);
+    for (std::size_t i = 0; i < coverage.size(); i++) {
+        coverage[i] = static_cast<std::uint8_t>(i * 37);
+    }
+    for (const si::sw::span_kernels* k : si::sw::span_kernels::supported()) {
+        si::sw::rasterizer r(*k);
+        const double opaque = megapixels_per_second([&]() { r.fill(t, screen, screen, 0xff3060c0); });
+        const double translucent = megapixels_per_second([&]() { r.fill(t, screen, screen, 0x803060c0); });
+        const double blit = megapixels_per_second([&]() { r.blit(t, screen, screen, source, 0.0f, 0.0f, 1.0f, 1.0f); });
+        const double mask = megapixels_per_second([&]() { r.mask(t, screen, 0, 0, coverage.data(), width, height, width, 0xff3060c0); });
+        fmt::print (
+            "{:>6}: opaque fill {:.0f} MP/s, translucent fill {:.0f} MP/s, blit {:.0f} MP/s, mask {:.0f} MP/s\n",
+            k->name, opaque, translucent, blit, mask
+        );
+    }
+    return 0;
+}
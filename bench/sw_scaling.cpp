@@ -0,0 +1,36 @@
+#include "common.hpp"
+#include <si/sw_renderer.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+// Frame time of the tiled software renderer on 1 to 16 threads, drawing a
+// 4K scene from scratch every frame. Past the hardware's thread count the
+// extra workers only contend for it.
+namespace {
+    constexpr std::uint32_t width = 3840;
+    constexpr std::uint32_t height = 2160;
+    constexpr std::uint32_t rect_count = 20000;
+
+    double ms_per_frame(std::size_t threads, const si::sw::target& t) {
+        si::sw::renderer r(width, height, threads);
+        si::bench::add_scene(r, rect_count, 0, width, height);
+        return si::bench::ms_per_frame(3, 30, [&](int) { r.draw(t); }, []() {});
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    std::vector<std::uint32_t> pixels(std::size_t{width} * height);
+    const si::sw::target t { pixels.data(), width, height, width };
+    fmt::print("{} hardware threads, {} span kernels\n", std::thread::hardware_concurrency(), si::sw::span_kernels::best().name);
+    const double single = ms_per_frame(1, t);
+    fmt::print("{:>2} thread(s): {:.2f} ms/frame\n", 1, single);
+    for (std::size_t threads : {2u, 4u, 8u, 16u}) {
+        const double ms = ms_per_frame(threads, t);
+        fmt::print("{:>2} thread(s): {:.2f} ms/frame, {:.2f}x\n", threads, ms, single / ms);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <si/vk_renderer.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+// A text-heavy table drawn on a headless renderer, first with cold glyph and
+// shaping caches, then warm with the same cells, then warm with every cell's
+// value changing each frame as a live table's would. The font is $SI_FONT,
+// or DejaVu Sans where distributions usually put it.
+namespace {
+    using clock = std::chrono::steady_clock;
+    constexpr std::uint32_t width = 1920;
+    constexpr std::uint32_t height = 1080;
+    constexpr std::uint32_t columns = 12;
+    constexpr std::uint32_t rows = 60;
+    constexpr int timed_frames = 50;
+    // meson reports benchmarks and tests exiting with this as skipped
+    constexpr int skipped = 77;
+
+    void add_table(si::vk::renderer& r, const std::string& font, std::uint32_t frame, bool live) {
+        r.clear();
+        for (std::uint32_t row = 0; row < rows; row++) {
+            for (std::uint32_t column = 0; column < columns; column++) {
+                const std::uint32_t value = (row * columns + column) * 7919 + (live ? frame * 104729 : 0);
+                r.add_text(si::text {
+                    .x = column * 160.0f,
+                    .y = row * 18.0f,
+                    .content = fmt::format("{}.{:02} kB/s", value % 100000, value % 100),
+                    .font = font,
+                    .size = 14.0f
+                });
+            }
+        }
+    }
+    std::uint64_t glyphs_looked_up(const si::vk::renderer& r) {
+        const si::vk::text_stats& stats = r.text.stats();
+        return stats.glyph_hits + stats.glyph_misses;
+    }
+    // Times frames of the table from first_frame on, through the GPU finishing them
+    void run(si::vk::renderer& r, const std::string& font, const char* name, int frames, int first_frame, bool live) {
+        const si::vk::text_stats before = r.text.stats();
+        const std::uint64_t glyphs_before = glyphs_looked_up(r);
+        const auto start = clock::now();
+        for (int i = 0; i < frames; i++) {
+            add_table(r, font, first_frame + i, live);
+            r.invalidate();
+            r.draw();
+        }
+        r.device.logical->waitIdle();
+        const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count() / frames;
+        const std::uint64_t glyphs = (glyphs_looked_up(r) - glyphs_before) / frames;
+        fmt::print (
+            "{}: {:.3f} ms/frame, {} glyphs/frame, {:.0f} glyphs/ms, {} glyph misses, {} shaping misses\n",
+            name, ms, glyphs, glyphs / ms,
+            r.text.stats().glyph_misses - before.glyph_misses, r.text.stats().shaping_misses - before.shaping_misses
+        );
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    const char* env = std::getenv("SI_FONT");
+    const std::string font = env && *env ? env : "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+    if (!std::filesystem::exists(font)) {
+        fmt::print("No font at {}; set SI_FONT to one\n", font);
+        return skipped;
+    }
+    si::vk::root vk;
+    auto r = vk.make_headless_renderer(width, height);
+    // One frame: every glyph is rasterized and uploaded, every cell shaped
+    run(*r, font, "cold", 1, 0, false);
+    run(*r, font, "warm", timed_frames, 0, false);
+    run(*r, font, "warm, live values", timed_frames, 1, true);
+    return 0;
+}
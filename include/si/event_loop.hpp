@@ -0,0 +1,63 @@
+#ifndef SI_EVENT_LOOP_HPP_INCLUDED
+#define SI_EVENT_LOOP_HPP_INCLUDED
+
+#include <boost/signals2/signal.hpp>
+#include <functional>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace si {
+    // Waits on file descriptors with epoll and runs handlers for whichever
+    // become ready, on the thread that calls run(). Timers are timerfds, and
+    // other threads wake the loop through an eventfd, so a thread finishing
+    // some work posts a task instead of the loop having to poll for it.
+    class event_loop {
+        struct timer {
+            std::function<void()> handler;
+            bool repeating;
+        };
+        int epoll;
+        int wake_fd;
+        std::map<int, std::function<void(std::uint32_t)>> watches;
+        std::map<int, timer> timers; // by timerfd, which is also the timer's id
+        std::vector<std::uint32_t> ready; // events of the last wait, by fd
+        std::mutex posted_mutex;
+        std::vector<std::function<void()>> posted;
+        bool stopping = false;
+
+        void run_posted();
+        void fire(int timer_fd);
+    public:
+        event_loop();
+        event_loop(const event_loop&) = delete;
+        ~event_loop();
+        // Calls handler with the ready events (EPOLLIN etc.) whenever fd has
+        // any of events. The loop doesn't own fd; unwatch it before closing it.
+        void watch(int fd, std::uint32_t events, std::function<void(std::uint32_t)> handler);
+        void unwatch(int fd);
+        // Calls handler after delay, then every interval if it's non-zero.
+        // Returns an id for cancel_timer.
+        int add_timer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval, std::function<void()> handler);
+        void cancel_timer(int id);
+        // Runs task on the loop's thread. Safe to call from any thread.
+        void post(std::function<void()> task);
+        // Wakes the loop without giving it anything to do but run before_wait again
+        void wake();
+        // The events fd was ready with in the last wait, if any
+        std::uint32_t ready_events(int fd) const;
+        // Until stop(), waits for something to be ready and handles it
+        void run();
+        // From the loop's thread; others can post() it
+        void stop();
+
+        // Just before waiting, e.g. to flush requests; and just after, before
+        // any handler has run, e.g. to read what a source prepared to read.
+        boost::signals2::signal<void()> before_wait;
+        boost::signals2::signal<void()> after_wait;
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SI_FONT_HPP_INCLUDED
+#define SI_FONT_HPP_INCLUDED
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <cstdint>
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+namespace si {
+    struct ft_library_deleter {
+        void operator()(FT_LibraryRec_*) const;
+    };
+    struct ft_face_deleter {
+        void operator()(FT_FaceRec_*) const;
+    };
+
+    struct glyph_key {
+        std::uint32_t face;
+        std::uint32_t glyph; // FreeType glyph index, not a code point
+        std::uint32_t size;  // pixels
+        auto operator<=>(const glyph_key&) const = default;
+    };
+    struct shaped_glyph {
+        std::uint32_t glyph;
+        std::int32_t x; // pen position from the start of the run
+    };
+    struct shaped_run {
+        std::vector<shaped_glyph> glyphs;
+        std::int32_t advance;
+        std::int32_t ascender;
+    };
+    // A rendered glyph as 8 bit coverage, whatever FreeType rendered it as
+    struct glyph_coverage {
+        std::int32_t left; // from the pen position to the bitmap's left edge
+        std::int32_t top;  // from the baseline up to the bitmap's top edge
+        std::uint32_t width;
+        std::uint32_t height;
+        std::int32_t pitch;
+        const unsigned char* pixels; // only until the next render()
+    };
+
+    // The fonts both renderers draw text with: faces loaded once per path,
+    // text laid out into glyphs, and glyphs rendered to coverage. Caching
+    // what it returns is left to the renderers, which keep it differently.
+    class font_library {
+        std::unique_ptr<FT_LibraryRec_, ft_library_deleter> library;
+        std::map<std::string, std::uint32_t> face_ids;
+        std::vector<std::unique_ptr<FT_FaceRec_, ft_face_deleter>> faces;
+        std::vector<unsigned char> widened; // 1 bit glyphs, as 8 bit coverage
+    public:
+        font_library();
+        font_library(const font_library&) = delete;
+        // The id of the face at path, loading it the first time
+        std::uint32_t face(const std::string& path);
+        // No complex script shaping: one glyph per code point, placed by advance and kerning
+        shaped_run shape(const std::string& content, std::uint32_t face, std::uint32_t size);
+        // nullopt if FreeType can't load the glyph. Glyphs that aren't
+        // coverage at all, like colour emoji, come back empty.
+        std::optional<glyph_coverage> render(const glyph_key& key);
+    };
+}
+
+#endif
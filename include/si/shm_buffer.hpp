@@ -1,22 +1,95 @@
 #ifndef SI_SHM_BUFFER_HPP_INCLUDED
 #define SI_SHM_BUFFER_HPP_INCLUDED
 
-#include <boost/interprocess/shared_memory_object.hpp>
-#include <boost/interprocess/mapped_region.hpp>
 #include <si/wl/shm_pool.hpp>
 #include <si/wl/shm.hpp>
 #include <si/wl/buffer.hpp>
+#include <si/wl/surface.hpp>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
 
 inline constexpr int bytes_per_pixel = 4;
 
-class shm_buffer {
-    static boost::interprocess::shared_memory_object make_shm_obj(int width, int height);
-public:
-    boost::interprocess::shared_memory_object shm_obj;
-    boost::interprocess::mapped_region pixels;
-    wl::shm_pool pool;
+// One buffer of a shm_swapchain: ARGB8888 rows of width pixels, tightly packed.
+struct shm_buffer {
+    std::uint64_t id;    // never reused by the swapchain, so drawers can remember what each buffer holds
+    std::int32_t offset; // into the pool
+    std::int32_t width;
+    std::int32_t height;
+    std::uint32_t* pixels; // moves when the pool grows, so only hold onto it until the next acquire()
     wl::buffer buffer;
-    shm_buffer(wl::shm&, int width, int height);
+    bool busy = false;  // committed, and not yet released by the compositor
+    bool stale = false; // sized for before a resize; freed once released
+
+    shm_buffer(wl::shm_pool& pool, std::uint64_t id, std::int32_t offset, std::int32_t width, std::int32_t height, std::uint32_t* pixels);
+    std::size_t size() const;
+};
+
+// Buffer pixels that changed since the last buffer presented
+struct shm_damage {
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t width;
+    std::int32_t height;
+};
+
+// An anonymous memfd, sealed against shrinking; closed on destruction
+struct shm_file {
+    int fd;
+
+    explicit shm_file(std::size_t size);
+    shm_file(const shm_file&) = delete;
+    ~shm_file();
+};
+
+// A shared read/write mapping of a whole shm_file; unmapped on destruction
+struct shm_mapping {
+    std::byte* data;
+    std::size_t size;
+
+    shm_mapping(const shm_file& file, std::size_t size);
+    shm_mapping(const shm_mapping&) = delete;
+    ~shm_mapping();
+    // Grows the mapping in place or moves it, along with the file
+    void grow(const shm_file& file, std::size_t size);
+};
+
+// Buffers carved out of one wl_shm_pool over an anonymous memfd. A buffer
+// is only handed out once the compositor has released it, so drawing never
+// tears what's on screen; if every buffer is busy another is added, up to
+// max_buffers, rather than waiting. The file is sealed against shrinking
+// so the compositor can map it safely, and grows along with the pool.
+// min_buffers are made up front; a 0x0 size is taken as 1x1, since the
+// pool and its buffers can't be empty.
+class shm_swapchain {
+    shm_file file;
+    shm_mapping mapping;
+    wl::shm_pool pool;
+    std::vector<std::unique_ptr<shm_buffer>> buffers;
+    std::int32_t width;
+    std::int32_t height;
+    std::uint64_t next_id = 1;
+
+    // The lowest offset with room for size bytes between the buffers still alive
+    std::size_t place(std::size_t size) const;
+    void grow(std::size_t size);
+    shm_buffer& add_buffer();
+public:
+    static constexpr std::size_t min_buffers = 2;
+    static constexpr std::size_t max_buffers = 3;
+
+    shm_swapchain(wl::shm& shm, std::int32_t width, std::int32_t height);
+    shm_swapchain(const shm_swapchain&) = delete;
+    // A buffer the compositor isn't reading, or nullptr if all of them are
+    // busy; try again once one has been released.
+    shm_buffer* acquire();
+    // Attaches and commits the buffer, which stays busy until released.
+    // With no damage given, all of it is taken to have changed.
+    void present(wl::surface& surface, shm_buffer& buffer, const std::vector<shm_damage>& damage = {});
+    // Buffers still on screen are kept until released; new ones take the new size
+    void resize(std::int32_t width, std::int32_t height);
 };
 
 #endif
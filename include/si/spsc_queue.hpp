@@ -0,0 +1,48 @@
+#ifndef SI_SPSC_QUEUE_HPP_INCLUDED
+#define SI_SPSC_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <array>
+#include <optional>
+#include <cstddef>
+
+namespace si {
+    // A fixed-size ring passing values from exactly one producer thread to
+    // exactly one consumer thread without locks. Each side only writes its
+    // own index, and the indices sit on separate cache lines so the two
+    // threads don't keep stealing one line from each other.
+    template <typename T, std::size_t capacity>
+    class spsc_queue {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+        static constexpr std::size_t line = 64;
+
+        std::array<std::optional<T>, capacity> slots;
+        alignas(line) std::atomic<std::size_t> head {0}; // next to pop; written by the consumer
+        alignas(line) std::atomic<std::size_t> tail {0}; // next to push; written by the producer
+    public:
+        // From the producer. False, leaving value alone, if the queue is full.
+        bool push(T&& value) {
+            const std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == capacity) {
+                return false;
+            }
+            slots[t & (capacity - 1)].emplace(std::move(value));
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        // From the consumer. The oldest value pushed, or nullopt if there are none.
+        std::optional<T> pop() {
+            const std::size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) {
+                return std::nullopt;
+            }
+            std::optional<T>& slot = slots[h & (capacity - 1)];
+            std::optional<T> value = std::move(slot);
+            slot.reset();
+            head.store(h + 1, std::memory_order_release);
+            return value;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef SI_SW_RASTER_HPP_INCLUDED
+#define SI_SW_RASTER_HPP_INCLUDED
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace si {
+    namespace sw {
+        // Pixels are 0xAARRGGBB with premultiplied alpha, which is what
+        // WL_SHM_FORMAT_ARGB8888 means, so frames can be presented as drawn.
+        std::uint32_t premultiply(std::uint32_t argb);
+
+        // Composites a row of n pixels over dst. Every variant gives the same
+        // result to the bit, so tiles drawn by different kernels match up.
+        struct span_kernels {
+            const char* name;
+            // dst = colour over dst
+            void (*fill)(std::uint32_t* dst, std::size_t n, std::uint32_t colour);
+            // dst = src over dst, pixel by pixel
+            void (*blend)(std::uint32_t* dst, const std::uint32_t* src, std::size_t n);
+            // dst = colour * coverage over dst, with coverage 0-255 per pixel
+            void (*mask)(std::uint32_t* dst, const std::uint8_t* coverage, std::size_t n, std::uint32_t colour);
+
+            static const span_kernels scalar;
+            static const span_kernels sse2;
+            static const span_kernels avx2;
+            // The kernels this CPU can run, slowest first
+            static std::vector<const span_kernels*> supported();
+            // The fastest supported, unless SI_SW_KERNELS names another
+            static const span_kernels& best();
+            static const span_kernels* find(std::string_view name);
+        };
+
+        // Where drawing goes: rows of width pixels, stride pixels apart
+        struct target {
+            std::uint32_t* pixels;
+            std::int32_t width;
+            std::int32_t height;
+            std::int32_t stride;
+        };
+        // Whole pixels from x0, y0 up to but excluding x1, y1
+        struct box {
+            std::int32_t x0 = 0;
+            std::int32_t y0 = 0;
+            std::int32_t x1 = 0;
+            std::int32_t y1 = 0;
+            bool empty() const {
+                return x0 >= x1 || y0 >= y1;
+            }
+        };
+        box intersect(const box& a, const box& b);
+        // Pixels whose centres a float rect covers, as the GPU rasterizes it
+        box snap(float x, float y, float width, float height);
+
+        // An image to blit, already premultiplied
+        struct image {
+            std::int32_t width = 0;
+            std::int32_t height = 0;
+            std::vector<std::uint32_t> pixels;
+        };
+        enum class gradient_direction {
+            horizontal, // from at the left edge, to at the right
+            vertical    // from at the top, to at the bottom
+        };
+
+        // Draws UI primitives into a target, a span at a time, never outside
+        // the clip box. Colours are straight 0xAARRGGBB, as in si::rect.
+        class rasterizer {
+            const span_kernels* kernels;
+            std::vector<std::uint32_t> row;     // scratch source pixels for one span
+            std::vector<std::uint8_t> coverage; // scratch coverage for one span
+        public:
+            explicit rasterizer(const span_kernels& kernels = span_kernels::best());
+            const span_kernels& span() const;
+            void fill(const target& t, const box& clip, const box& b, std::uint32_t colour);
+            // Colour blended across the box, in sRGB space as the GPU would with unorm attributes
+            void fill_gradient(const target& t, const box& clip, const box& b, std::uint32_t from, std::uint32_t to, gradient_direction direction);
+            // Corners of the given radius, antialiased by their coverage of each pixel
+            void fill_rounded(const target& t, const box& clip, const box& b, float radius, std::uint32_t colour);
+            // A frame of the given width inside the box, leaving the middle untouched
+            void stroke(const target& t, const box& clip, const box& b, std::int32_t width, std::uint32_t colour);
+            // The region of img (in normalised coordinates) scaled to the box,
+            // nearest texel, and tinted by colour as textured rects are
+            void blit(const target& t, const box& clip, const box& b, const image& img, float u0, float v0, float u1, float v1, std::uint32_t colour = 0xffffffff);
+            // An 8 bit coverage bitmap, such as a glyph, at x, y in colour
+            void mask(const target& t, const box& clip, std::int32_t x, std::int32_t y, const std::uint8_t* bitmap, std::int32_t width, std::int32_t height, std::int32_t pitch, std::uint32_t colour);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SI_SW_RENDERER_HPP_INCLUDED
+#define SI_SW_RENDERER_HPP_INCLUDED
+
+#include <si/sw_raster.hpp>
+#include <si/shm_buffer.hpp>
+#include <si/thread_pool.hpp>
+#include <si/ui.hpp>
+#include <si/font.hpp>
+#include <si/wl/shm.hpp>
+#include <si/wl/surface.hpp>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace si {
+    namespace sw {
+        struct glyph_bitmap {
+            std::int32_t left; // from the pen position to the bitmap's left edge
+            std::int32_t top;  // from the baseline up to the bitmap's top edge
+            std::int32_t width;
+            std::int32_t height;
+            std::vector<std::uint8_t> coverage; // rows of width bytes
+        };
+
+        // One primitive of the scene, as the rasterizer draws it
+        struct command {
+            enum class kind : std::uint8_t { fill, stroke, blit, mask };
+            kind what;
+            box bounds;
+            std::uint32_t colour;
+            std::int32_t stroke_width = 0;
+            std::uint32_t image = 0;                 // blit: index into the renderer's images
+            float u0 = 0.0f, v0 = 0.0f, u1 = 1.0f, v1 = 1.0f;
+            const glyph_bitmap* glyph = nullptr;     // mask; glyphs are never evicted
+        };
+
+        // Draws the scene on the CPU into shm buffers, for when there's no
+        // usable GPU. The frame is split into tiles, each drawn by one worker
+        // from just the commands that touch it. Tiles are only redrawn where
+        // their commands differ from what the buffer being drawn into already
+        // holds, and only tiles that differ from the last frame are damaged.
+        class renderer {
+            font_library fonts;
+            std::map<glyph_key, glyph_bitmap> glyphs;
+            std::vector<image> images;
+            std::optional<shm_swapchain> swapchain; // none when headless
+            std::int32_t width;
+            std::int32_t height;
+            thread_pool workers;
+            std::vector<rasterizer> rasterizers; // one per worker
+            std::vector<command> commands;
+            std::vector<std::vector<std::uint32_t>> bins; // commands touching each tile, in order
+            std::vector<std::uint64_t> tile_hashes;       // of each tile's commands this frame
+            std::vector<std::uint64_t> presented;         // tile hashes of the frame on screen
+            std::map<std::uint64_t, std::vector<std::uint64_t>> contents; // tile hashes each buffer holds, by id
+            bool full_damage = true;
+            bool scene_changed = false;
+
+            const glyph_bitmap* glyph(std::uint32_t face, std::uint32_t index, std::uint32_t size);
+            std::int32_t tiles_x() const;
+            std::int32_t tiles_y() const;
+            void bin();
+            void draw_tile(std::uint32_t tile, const target& t, rasterizer& r) const;
+        public:
+            static constexpr std::int32_t tile_size = 64;
+            std::uint32_t background = 0xff000000; // what tiles are cleared to, 0xAARRGGBB
+
+            renderer(wl::shm& shm, std::int32_t width, std::int32_t height, std::size_t threads = std::thread::hardware_concurrency());
+            // Draws only into targets given to draw(), for benchmarks and tests without a compositor
+            renderer(std::int32_t width, std::int32_t height, std::size_t threads = std::thread::hardware_concurrency());
+            renderer(const renderer&) = delete;
+            // Draws and presents whatever tiles changed. Returns false without
+            // drawing if none did, or if every buffer is still on screen. A
+            // buffer's release is a display event, so the loop dispatching it
+            // wakes up and can call this again.
+            bool draw(wl::surface& surface);
+            // Draws every tile into t, which is width by height, whether or not it changed
+            void draw(const target& t);
+            bool needs_redraw() const;
+            void resize(std::int32_t width, std::int32_t height);
+            // Loads an image for rects to sample, by its index in the texture region
+            si::texture_region load_texture(std::string filepath);
+            void add_rect(const si::rect& r);
+            void add_text(const si::text& t);
+            // Starts a new scene, forgetting every rect and text added so far
+            void clear();
+            // Redraws every tile of every buffer
+            void invalidate();
+        };
+    }
+}
+
+#endif
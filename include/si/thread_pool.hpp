@@ -0,0 +1,52 @@
+#ifndef SI_THREAD_POOL_HPP_INCLUDED
+#define SI_THREAD_POOL_HPP_INCLUDED
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+namespace si {
+    // A fixed set of threads that split loops with the thread that calls
+    // parallel_for. Items are handed out one at a time, so uneven items still
+    // balance. Worker 0 is always the caller. Between loops, the threads also
+    // run tasks posted to run in the background.
+    class thread_pool {
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        const std::function<void(std::size_t, std::size_t)>* job = nullptr;
+        std::size_t job_items = 0;
+        std::atomic<std::size_t> next_item;
+        std::size_t busy = 0;
+        std::uint64_t generation = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+        std::deque<std::function<void()>> tasks;
+
+        void run(const std::function<void(std::size_t, std::size_t)>& fn, std::size_t items, std::size_t worker);
+        void work(std::size_t worker);
+    public:
+        // Defaults to one worker per hardware thread, the caller included
+        explicit thread_pool(std::size_t workers = std::thread::hardware_concurrency());
+        thread_pool(const thread_pool&) = delete;
+        ~thread_pool();
+        std::size_t size() const;
+        // Calls fn(item, worker) for every item in [0, items) and returns once
+        // they've all returned. Rethrows the first exception any of them threw.
+        void parallel_for(std::size_t items, const std::function<void(std::size_t, std::size_t)>& fn);
+        // Runs task on one of the pool's threads, or right away if it has none
+        // besides the caller. Tasks still queued when the pool is destroyed
+        // never run, and exceptions escaping a task are dropped.
+        void post(std::function<void()> task);
+    };
+}
+
+#endif
@@ -3,19 +3,54 @@
 
 #include <variant>
 #include <string>
+#include <optional>
+#include <cstdint>
 
 namespace si {
+    // How a window trades latency against smoothness and power. Negotiated
+    // against what the display actually supports when the renderer is made.
+    enum class present_policy {
+        low_latency, // mailbox or immediate, fewest images
+        smooth,      // fifo, triple buffered
+        power_saver  // fifo, fewest images, frame rate throttled
+    };
     struct window {
         int width;
         int height;
+        present_policy presentation = present_policy::smooth;
     };
     // text
+    struct text {
+        float x = 0.0f; // top left of the line, in pixels
+        float y = 0.0f;
+        std::string content; // UTF-8
+        std::string font;    // path of a font file FreeType can open
+        float size = 16.0f;  // pixels
+        std::uint32_t colour = 0xff000000; // 0xAARRGGBB
+    };
     // rect
     // image
     // layouts
     // etc.
+    // A texture the renderer has loaded, and where it lies within the
+    // (possibly shared) image, in normalised coordinates.
+    struct texture_region {
+        std::uint32_t texture = 0;
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 1.0f;
+        float height = 1.0f;
+    };
+    // Positions and sizes are in pixels from the window's top left
     struct rect {
-        std::uint32_t colour;
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+        std::uint32_t colour = 0xffffffff; // 0xAARRGGBB
+        std::uint32_t border_colour = 0;
+        float border_width = 0.0f;
+        std::optional<texture_region> texture;
     };
     void run(const window&);
 }
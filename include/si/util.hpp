@@ -4,9 +4,15 @@
 #include <cstddef>
 #include <vector>
 #include <string>
+#include <filesystem>
 
 namespace si {
     std::vector<std::byte> file_contents(std::string filename);
+    void write_file_contents(const std::filesystem::path& filename, const std::vector<std::byte>& contents);
+    // $XDG_CACHE_HOME/si, falling back to ~/.cache/si. Not created.
+    std::filesystem::path cache_directory();
+    // Decodes the UTF-8 code point at it, advancing past it. Malformed input decodes as U+FFFD.
+    char32_t next_code_point(std::string::const_iterator& it, std::string::const_iterator end);
 }
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef SI_VK_ALLOCATOR_HPP_INCLUDED
+#define SI_VK_ALLOCATOR_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace si {
+    namespace vk {
+        // Buffers and linearly tiled images are kept in different blocks from
+        // optimally tiled images so that bufferImageGranularity never applies.
+        enum class resource_kind { linear, optimal };
+
+        class memory_allocator;
+        struct memory_block;
+
+        // A range of a (usually shared) VkDeviceMemory. Returns itself to the
+        // allocator when destroyed, like the Unique handles it replaces.
+        class allocation {
+            friend class memory_allocator;
+            memory_allocator* owner = nullptr;
+            memory_block* block = nullptr;
+            std::uint32_t order = 0;
+            allocation(memory_allocator* owner, memory_block* block, ::vk::DeviceSize offset, ::vk::DeviceSize size, std::uint32_t order);
+        public:
+            ::vk::DeviceMemory memory;
+            ::vk::DeviceSize offset = 0;
+            ::vk::DeviceSize size = 0;
+
+            allocation() = default;
+            allocation(const allocation&) = delete;
+            allocation(allocation&&) noexcept;
+            allocation& operator=(allocation&&) noexcept;
+            ~allocation();
+            void reset();
+            explicit operator bool() const;
+            // Host-visible blocks are mapped once for their whole lifetime, so
+            // this is valid for as long as the allocation is.
+            std::byte* mapped() const;
+        };
+
+        struct allocator_stats {
+            std::size_t device_allocations = 0;   // live vkAllocateMemory calls
+            std::size_t live_allocations = 0;     // live sub-allocations
+            std::uint64_t total_allocations = 0;  // sub-allocations since creation
+            double allocations_per_second = 0.0;
+            ::vk::DeviceSize reserved_bytes = 0;  // sum of block sizes
+            ::vk::DeviceSize used_bytes = 0;      // after rounding up to a buddy size
+            ::vk::DeviceSize requested_bytes = 0;
+            double internal_fragmentation = 0.0;  // 1 - requested / used
+            double external_fragmentation = 0.0;  // 1 - largest free range / total free
+        };
+
+        // Power-of-two buddy allocator with one set of blocks per memory type
+        // and resource kind. Requests larger than half a block get a dedicated
+        // VkDeviceMemory of their own.
+        class memory_allocator {
+            friend class allocation;
+            ::vk::Device device;
+            ::vk::PhysicalDeviceMemoryProperties memory_properties;
+            std::uint32_t max_allocation_count;
+            std::vector<std::vector<std::unique_ptr<memory_block>>> pools; // indexed by memory type * 2 + kind
+            mutable std::mutex mutex;
+            std::chrono::steady_clock::time_point created;
+            std::uint64_t total_allocations = 0;
+            ::vk::DeviceSize requested_bytes = 0;
+
+            memory_block& add_block(std::size_t pool_ix, std::uint32_t memory_type, ::vk::DeviceSize size, bool dedicated);
+            void free(allocation&);
+        public:
+            static constexpr std::uint32_t min_order = 8;   // 256 B
+            static constexpr std::uint32_t max_order = 26;  // 64 MiB
+
+            memory_allocator(::vk::PhysicalDevice physical, ::vk::Device device);
+            memory_allocator(const memory_allocator&) = delete;
+            ~memory_allocator();
+            allocation allocate(::vk::MemoryRequirements reqs, std::uint32_t memory_type, resource_kind kind);
+            allocator_stats stats() const;
+        };
+    }
+}
+
+#endif
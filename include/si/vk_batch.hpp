@@ -0,0 +1,63 @@
+#ifndef SI_VK_BATCH_HPP_INCLUDED
+#define SI_VK_BATCH_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <si/ui.hpp>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace si {
+    namespace vk {
+        // The fragment work a pipeline does, chosen with specialization constants.
+        struct pipeline_variant {
+            bool textured = true;
+            bool coloured = false;
+            bool instanced = false; // draws rect_instances rather than vertices
+            auto operator<=>(const pipeline_variant&) const = default;
+        };
+        // One rectangle as the rect shaders read it, at vertex input rate instance.
+        struct rect_instance {
+            glm::vec4 bounds;            // x, y, width, height in pixels
+            glm::vec4 uv;                // u0, v0, u1, v1 of the texture region
+            std::uint32_t colour;        // 0xAARRGGBB
+            std::uint32_t border_colour; // 0xAARRGGBB
+            float border_width;          // in pixels
+            std::uint32_t texture;       // slot in texture_manager's descriptor array, or untextured
+            static constexpr std::uint32_t untextured = 0xffffffff;
+            static ::vk::VertexInputBindingDescription binding_description;
+            static std::array<::vk::VertexInputAttributeDescription, 6> input_descriptions;
+        };
+        // A run of instances drawn with a single pipeline.
+        struct batch_draw {
+            pipeline_variant variant;
+            std::uint32_t first_instance;
+            std::uint32_t instance_count;
+        };
+
+        // Rects in the order they were added, so later ones paint over earlier
+        // ones, drawn with one instanced draw however many there are. Textures
+        // are indexed rather than bound, and untextured rects carry a sentinel
+        // slot instead of needing a pipeline of their own, so neither splits
+        // the batch or reorders it.
+        class rect_batch {
+            std::vector<rect_instance> instances;
+            std::vector<rect_instance> drawn; // instances as of the last collect_damage
+        public:
+            static constexpr pipeline_variant variant { .textured = true, .coloured = true, .instanced = true };
+
+            void add(const si::rect& r);
+            // Forgets every rect but keeps the storage for the next frame's.
+            void clear();
+            std::size_t size() const;
+            // Writes the instances contiguously to dst, which must have room for size() of them.
+            std::vector<batch_draw> write(rect_instance* dst) const;
+            // Appends the pixel bounds of every rect added, removed or changed
+            // since the last call, comparing the batch position by position.
+            void collect_damage(std::vector<::vk::Rect2D>& damage);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SI_VK_PIPELINE_CACHE_HPP_INCLUDED
+#define SI_VK_PIPELINE_CACHE_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <filesystem>
+#include <cstddef>
+
+namespace si {
+    namespace vk {
+        // A VkPipelineCache persisted under the XDG cache directory, one file
+        // per device. Data written by a different driver or device is ignored.
+        class pipeline_cache {
+            ::vk::Device device;
+            std::filesystem::path path;
+            ::vk::UniquePipelineCache cache;
+        public:
+            bool loaded = false; // whether usable data was found on disk
+
+            pipeline_cache(::vk::PhysicalDevice physical, ::vk::Device device);
+            pipeline_cache(const pipeline_cache&) = delete;
+            ~pipeline_cache();
+            ::vk::PipelineCache operator*() const;
+            std::size_t data_size() const;
+            void save() const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SI_VK_PROFILER_HPP_INCLUDED
+#define SI_VK_PROFILER_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+namespace si {
+    namespace vk {
+        struct gfx_device;
+
+        // Counted between a scope's begin and end; in the order Vulkan writes them
+        struct gpu_pipeline_statistics {
+            std::uint64_t input_vertices = 0;
+            std::uint64_t input_primitives = 0;
+            std::uint64_t vertex_invocations = 0;
+            std::uint64_t clipped_primitives = 0; // primitives out of the clipper, i.e. rasterized
+            std::uint64_t fragment_invocations = 0;
+        };
+        struct gpu_scope_timing {
+            std::string name;
+            std::uint32_t depth;  // scopes open around this one
+            double start_ms;      // from the start of the frame's first scope
+            double duration_ms;
+            std::optional<gpu_pipeline_statistics> statistics;
+        };
+        struct gpu_frame_timing {
+            std::uint64_t serial;
+            double start_ms;      // from the first frame the profiler read back
+            std::vector<gpu_scope_timing> scopes;
+        };
+
+        // Times named scopes of command buffers with timestamp queries. Each
+        // frame in flight has its own query pools, read back when that frame's
+        // slot is next recorded: by then its fence has been waited for, so
+        // reading never stalls, and results lag by the number of frames in flight.
+        class gpu_profiler {
+            struct open_scope {
+                std::string name;
+                std::uint32_t depth;
+                std::optional<std::uint32_t> statistics_query;
+            };
+            struct slot {
+                ::vk::UniqueQueryPool timestamps;
+                ::vk::UniqueQueryPool statistics;
+                std::vector<open_scope> scopes;
+                std::uint32_t statistics_used = 0;
+                std::uint64_t serial = 0;
+            };
+            ::vk::Device device;
+            std::vector<slot> slots;
+            std::size_t current = 0;
+            std::uint32_t depth = 0;
+            double period_ns = 0.0;   // per timestamp tick
+            std::uint64_t valid_mask = 0;
+            std::optional<std::uint64_t> epoch;
+            std::deque<gpu_frame_timing> history;
+
+            void read_back(slot& s);
+        public:
+            static constexpr std::uint32_t max_scopes = 32;      // per frame
+            static constexpr std::size_t max_history = 240;     // frames kept for frames()
+            static constexpr std::uint32_t no_scope = std::numeric_limits<std::uint32_t>::max();
+            static constexpr ::vk::QueryPipelineStatisticFlags statistic_flags =
+                ::vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices
+                | ::vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives
+                | ::vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+                | ::vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+                | ::vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+            gpu_profiler(gfx_device& device, std::uint32_t frames_in_flight);
+            // False if the graphics queue has no timestamps, in which case every call is a no-op
+            bool enabled() const;
+            bool has_statistics() const;
+            // Reads back what the slot's last frame measured, then resets its queries.
+            // Call outside a render pass, once the slot's previous submission has completed.
+            void begin_frame(::vk::CommandBuffer cmd, std::size_t frame_slot, std::uint64_t serial);
+            // Statistics are only counted if the device supports them; a scope
+            // counting them mustn't be opened inside a render pass.
+            std::uint32_t begin(::vk::CommandBuffer cmd, std::string_view name, bool statistics = false);
+            void end(::vk::CommandBuffer cmd, std::uint32_t scope);
+            // Oldest first
+            const std::deque<gpu_frame_timing>& frames() const;
+            // The history as a JSON array of frames, and as Chrome's trace event format
+            std::string json() const;
+            std::string chrome_trace() const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef SI_VK_RENDER_THREAD_HPP_INCLUDED
+#define SI_VK_RENDER_THREAD_HPP_INCLUDED
+
+#include <si/vk_renderer.hpp>
+#include <si/event_loop.hpp>
+#include <si/spsc_queue.hpp>
+#include <si/ui.hpp>
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <cstdint>
+
+namespace si {
+    namespace vk {
+        // What the UI thread changed since its last snapshot. Only what's set
+        // is applied; anything else stays as the render thread last had it.
+        struct frame_snapshot {
+            struct contents {
+                std::vector<si::rect> rects;
+                std::vector<si::text> texts;
+            };
+            std::optional<::vk::Extent2D> extent;
+            std::optional<contents> scene; // replaces every rect and text drawn so far
+            bool invalidate = false;
+            // Acks the configure this frame answers. It's called on the render
+            // thread just before that frame is drawn, so the ack can't land
+            // between the swapchain's attach and its commit.
+            std::function<void()> configure;
+            // Whether there's anything in it to send
+            bool empty() const;
+            // Folds a later snapshot into this one
+            void merge(frame_snapshot&& later);
+        };
+
+        // Owns a renderer and does all its drawing, acquiring and presenting
+        // on a thread of its own, so waiting on fences or for a swapchain
+        // image never holds up the thread dispatching input and configures.
+        // Snapshots reach it through a lock-free queue and are coalesced:
+        // however many arrive while a frame is being drawn, the next frame
+        // draws the latest state.
+        class render_thread {
+            std::unique_ptr<renderer> r;
+            event_loop loop; // run on the render thread; only wake() is called from others
+            spsc_queue<frame_snapshot, 16> snapshots;
+            frame_snapshot held; // UI thread only: what didn't fit in the queue
+            std::atomic<bool> backlogged {false};
+            std::function<void()> notify;
+            std::exception_ptr error; // written by the render thread before it exits
+            std::atomic<bool> failed {false};
+            std::atomic<std::uint64_t> drawn {0};
+            std::function<void()> configure; // render thread only: acked by the next draw
+            std::chrono::steady_clock::time_point last_drawn;
+            int throttle_timer = -1;
+            int upload_poll = -1;
+            std::thread thread;
+
+            void apply(frame_snapshot&& snapshot);
+            void render(); // before each wait of the render thread's loop
+        public:
+            // Starts drawing with renderer, which no other thread may touch
+            // from here on. notify is called on the render thread when the UI
+            // thread should flush(): once there's room for a snapshot held
+            // back, or once drawing has failed.
+            render_thread(std::unique_ptr<renderer> renderer, std::function<void()> notify);
+            render_thread(const render_thread&) = delete;
+            // Waits for the frame being drawn, if any, and stops the thread
+            ~render_thread();
+            // From the UI thread. Queues the snapshot, or holds it back to be
+            // merged with the next if the queue is full. Rethrows whatever
+            // stopped the render thread, if anything has.
+            void submit(frame_snapshot snapshot);
+            // From the UI thread. Retries sending anything held back, and
+            // rethrows whatever stopped the render thread.
+            void flush();
+            // Frames drawn and submitted so far; from any thread
+            std::uint64_t frames() const;
+        };
+    }
+}
+
+#endif
@@ -2,12 +2,26 @@
 #define SI_VK_RENDERER_HPP_INCLUDED
 
 #include <vulkan/vulkan.hpp>
+#include <si/vk_allocator.hpp>
+#include <si/vk_upload.hpp>
+#include <si/vk_pipeline_cache.hpp>
+#include <si/vk_batch.hpp>
+#include <si/vk_texture.hpp>
+#include <si/vk_text.hpp>
+#include <si/vk_profiler.hpp>
+#include <si/thread_pool.hpp>
 #include <si/wl/display.hpp>
 #include <si/wl/surface.hpp>
+#include <si/ui.hpp>
 #include <vector>
 #include <array>
 #include <memory>
 #include <cstdint>
+#include <map>
+#include <deque>
+#include <optional>
+#include <functional>
+#include <chrono>
 #include <glm/glm.hpp>
 
 namespace si {
@@ -17,9 +31,15 @@ namespace si {
         struct root {
             ::vk::UniqueInstance instance;
             VkDebugReportCallbackEXT debug_reporter;
-            std::vector<gfx_device> gfxs;
+            // Owned one by one: renderers keep references that must survive more being added
+            std::vector<std::unique_ptr<gfx_device>> gfxs;
             root();
-            std::unique_ptr<renderer> make_renderer(::wl::display&, ::wl::surface&, std::uint32_t width, std::uint32_t height);
+            // A device able to present to surface, or with no surface, any that can render
+            gfx_device& get_device(::vk::SurfaceKHR surface);
+            std::unique_ptr<renderer> make_renderer(::wl::display&, ::wl::surface&, std::uint32_t width, std::uint32_t height, present_policy policy = present_policy::smooth, std::uint32_t frames_in_flight = 2);
+            // Renders into images of its own instead of a window, for benchmarks and
+            // tests without a compositor. With readback, read_pixels() returns each frame.
+            std::unique_ptr<renderer> make_headless_renderer(std::uint32_t width, std::uint32_t height, bool readback = false, std::uint32_t frames_in_flight = 2);
         };
         struct gfx_device {
             ::vk::PhysicalDevice physical;
@@ -27,12 +47,23 @@ namespace si {
             std::uint32_t graphics_q_family_ix;
             ::vk::Queue present_q;
             std::uint32_t present_q_family_ix;
+            ::vk::Queue transfer_q; // a dedicated transfer queue if the device has one, otherwise graphics_q
+            std::uint32_t transfer_q_family_ix;
             ::vk::UniqueDevice logical;
+            bool presentable = false;         // VK_KHR_swapchain is enabled
+            bool incremental_present = false; // VK_KHR_incremental_present is enabled
+            bool pipeline_statistics = false; // pipelineStatisticsQuery and inheritedQueries are enabled
+            std::unique_ptr<memory_allocator> allocator; // behind a pointer so allocations survive gfx_device being moved
+            std::unique_ptr<pipeline_cache> pipelines;
 
-            gfx_device(::vk::PhysicalDevice physical, ::vk::Queue graphics_q, std::uint32_t graphics_q_ix, ::vk::Queue present_q, std::uint32_t present_q_ix, ::vk::UniqueDevice logical);
-            std::unique_ptr<renderer> make_renderer(::vk::UniqueSurfaceKHR, std::uint32_t width, std::uint32_t height);
+            gfx_device(::vk::PhysicalDevice physical, ::vk::Queue graphics_q, std::uint32_t graphics_q_ix, ::vk::Queue present_q, std::uint32_t present_q_ix, ::vk::Queue transfer_q, std::uint32_t transfer_q_ix, ::vk::UniqueDevice logical);
+            std::unique_ptr<renderer> make_renderer(::vk::UniqueSurfaceKHR, std::uint32_t width, std::uint32_t height, present_policy policy, std::uint32_t frames_in_flight, bool readback = false);
             std::uint32_t find_memory_type_index(::vk::MemoryRequirements reqs, ::vk::MemoryPropertyFlags flags);
-            std::tuple<::vk::UniqueBuffer, ::vk::UniqueDeviceMemory> make_buffer(::vk::DeviceSize buffer_size, ::vk::BufferUsageFlags buffer_usage, ::vk::SharingMode sharing_mode, ::vk::MemoryPropertyFlags memory_flags);
+            std::tuple<::vk::UniqueBuffer, allocation> make_buffer(::vk::DeviceSize buffer_size, ::vk::BufferUsageFlags buffer_usage, ::vk::SharingMode sharing_mode, ::vk::MemoryPropertyFlags memory_flags);
+            // Resources written on the transfer queue and read on the graphics queue
+            // are shared concurrently rather than passed between queue families.
+            ::vk::SharingMode upload_sharing_mode() const;
+            std::array<std::uint32_t, 2> upload_queue_families() const;
         };
         struct vertex {
             glm::vec2 pos;
@@ -41,61 +72,141 @@ namespace si {
             static ::vk::VertexInputBindingDescription binding_description;
             static std::array<::vk::VertexInputAttributeDescription, 3> input_descriptions;
         };
+        // Per-frame data, written into this frame's slot of the shared uniform buffer.
         struct uniform_buffer_object {
-            glm::mat4 model;
             glm::mat4 view;
             glm::mat4 proj;
         };
-        struct renderer {
-            gfx_device& device;
-            ::vk::UniqueSemaphore swapchain_image_available;
+        // Per-draw data, small enough to live in the 128 bytes of push constants every device offers.
+        struct push_constants {
+            glm::mat4 model;
+            glm::vec4 region;      // where the quad's texture lies in its slot: x, y, width, height
+            std::uint32_t texture; // slot in texture_manager's descriptor array
+        };
+        // One recording thread's share of a frame. Command pools aren't thread
+        // safe, so each thread records into secondaries from a pool of its own.
+        struct recording_worker {
+            ::vk::UniqueCommandPool pool;
+            std::vector<::vk::UniqueCommandBuffer> secondaries; // reused once pool is reset
+            std::size_t used = 0;
+        };
+        // Everything the CPU touches while recording a frame. The renderer cycles
+        // through a ring of these so that frame N+1 can be recorded while the GPU
+        // is still executing frame N.
+        struct frame_context {
+            ::vk::UniqueSemaphore image_available;
             ::vk::UniqueSemaphore render_finished;
             ::vk::UniqueFence in_flight;
-            ::vk::UniqueSurfaceKHR surface;
+            ::vk::UniqueCommandBuffer command_buffer;
+            std::uint32_t uniform_offset; // dynamic offset of this frame's slot in renderer::uniform_buffer
+            std::uint64_t serial = 0;     // renderer::frame_serial when last submitted
+            // This frame's copy of renderer::rects, rewritten each time the frame is recorded
+            ::vk::UniqueBuffer instance_buffer;
+            allocation instance_memory;
+            std::size_t instance_capacity = 0;
+            std::vector<batch_draw> draws;
+            std::vector<recording_worker> workers; // one per thread in renderer::recorders
+            // Headless renderers with readback copy each frame here, packed 0xAARRGGBB
+            ::vk::UniqueBuffer readback_buffer;
+            allocation readback_memory;
+            ::vk::Extent2D readback_extent;
+        };
+        // A headless frame read back to the host, as sRGB 0xAARRGGBB pixels in rows
+        struct frame_pixels {
+            ::vk::Extent2D extent;
+            std::vector<std::uint32_t> argb;
+        };
+        // A swapchain and the views/framebuffers onto it, kept alive after
+        // recreation until every frame that might still use them has finished.
+        struct retired_swapchain {
+            ::vk::UniqueSwapchainKHR swapchain;
+            std::vector<::vk::UniqueImage> offscreen_images; // instead of a swapchain when headless
+            std::vector<allocation> offscreen_memory;
+            std::vector<::vk::UniqueImageView> image_views;
+            std::vector<::vk::UniqueFramebuffer> framebuffers;
+            std::uint64_t last_serial;
+        };
+        // What one frame changed, kept so that an older swapchain image can be
+        // brought up to date by redrawing only what changed since it was drawn.
+        struct frame_damage {
+            std::uint64_t serial;
+            bool full;
+            std::vector<::vk::Rect2D> rects;
+        };
+        struct renderer {
+            gfx_device& device;
+            ::vk::UniqueSurfaceKHR surface; // null when headless
+            bool readback;
+            ::vk::ImageLayout target_layout; // what the render pass leaves images in for presenting or reading back
+            present_policy policy;
+            ::vk::PresentModeKHR present_mode;
+            // Callers should skip frames that come sooner than this after the last one
+            std::chrono::milliseconds min_frame_interval {0};
             //TODO: Get formats from surface
             //::vk::SurfaceFormatKHR surface_format;
             //::vk::PresentModeKHR surface_present_mode;
 
             //TODO: Move pipeline into gfx_device - maybe?
-            std::array<::vk::DescriptorSetLayoutBinding, 2> descriptor_set_layout_bindings = std::array {
+            // Textures are in set 1, owned by texture_manager
+            std::array<::vk::DescriptorSetLayoutBinding, 1> descriptor_set_layout_bindings = std::array {
                 // ubo binding
                 ::vk::DescriptorSetLayoutBinding()
                 .setBinding(0)
-                .setDescriptorType(::vk::DescriptorType::eUniformBuffer)
+                .setDescriptorType(::vk::DescriptorType::eUniformBufferDynamic)
                 .setDescriptorCount(1)
                 .setStageFlags(::vk::ShaderStageFlagBits::eVertex)
-                .setPImmutableSamplers(nullptr),
-                // sampler binding
-                ::vk::DescriptorSetLayoutBinding()
-                .setBinding(1)
-                .setDescriptorType(::vk::DescriptorType::eCombinedImageSampler)
-                .setDescriptorCount(1)
-                .setStageFlags(::vk::ShaderStageFlagBits::eFragment)
                 .setPImmutableSamplers(nullptr)
             };
             ::vk::UniqueDescriptorSetLayout descriptor_set_layout;
             ::vk::UniquePipelineLayout pipeline_layout;
             ::vk::UniqueRenderPass render_pass;
-            ::vk::UniquePipeline pipeline;
+            ::vk::UniqueRenderPass render_pass_load; // compatible with render_pass, but keeps the image's contents
+            ::vk::UniqueShaderModule vert_module;
+            ::vk::UniqueShaderModule frag_module;
+            ::vk::UniqueShaderModule rect_vert_module;
+            ::vk::UniqueShaderModule rect_frag_module;
+            std::map<pipeline_variant, ::vk::UniquePipeline> pipeline_variants;
             ::vk::UniqueCommandPool graphics_command_pool;
+            thread_pool recorders;
+            // Below this, a thread's share of the rects isn't worth the cost of a secondary command buffer
+            static constexpr std::uint32_t min_instances_per_secondary = 512;
+            // GPU time per frame; set SI_GPU_TRACE to a path to get a Chrome trace of it on exit
+            gpu_profiler profiler;
+            uploader uploads;
+            upload resources_ready;
+            texture_manager textures;
+            text_renderer text;
+            std::uint32_t backdrop; // texture stream
             ::vk::UniqueBuffer vertex_buffer;
-            ::vk::UniqueDeviceMemory vertex_buffer_memory;
+            allocation vertex_buffer_memory;
             ::vk::UniqueBuffer index_buffer;
-            ::vk::UniqueDeviceMemory index_buffer_memory;
-            std::vector<::vk::UniqueBuffer> uniform_buffers;
-            std::vector<::vk::UniqueDeviceMemory> uniform_buffer_memories;
+            allocation index_buffer_memory;
+            ::vk::UniqueBuffer uniform_buffer;
+            allocation uniform_buffer_memory;
+            ::vk::DeviceSize uniform_stride;
             ::vk::UniqueDescriptorPool descriptor_pool;
-            std::vector<::vk::DescriptorSet> descriptor_sets; // not unique because they'll be destroyed along with the above pool.
-            ::vk::UniqueImage texture_image;
-            ::vk::UniqueDeviceMemory texture_image_memory;
-            ::vk::UniqueImageView texture_image_view;
-            ::vk::UniqueSampler texture_sampler;
+            ::vk::DescriptorSet descriptor_set; // not unique because it's destroyed along with the above pool
             ::vk::Extent2D swapchain_extent;
             ::vk::UniqueSwapchainKHR swapchain;
             std::vector<::vk::Image> swapchain_images;
+            // Headless renderers draw into one of these per frame in flight instead of a swapchain
+            std::vector<::vk::UniqueImage> offscreen_images;
+            std::vector<allocation> offscreen_memory;
             std::vector<::vk::UniqueImageView> swapchain_image_views;
+            std::vector<retired_swapchain> retired_swapchains;
+            ::vk::Extent2D wanted_extent;
+            bool swapchain_stale = false;
             std::vector<::vk::UniqueFramebuffer> framebuffers;
-            std::vector<::vk::UniqueCommandBuffer> command_buffers;
+            std::vector<std::uint64_t> image_serials; // frame last drawn into each swapchain image; 0 while its contents are undefined
+            std::vector<::vk::Rect2D> pending_damage;
+            bool full_damage = true;
+            bool scene_changed = false; // rects or text were added or cleared since the last draw
+            std::deque<frame_damage> damage_history;
+            std::vector<frame_context> frames;
+            std::size_t current_frame = 0;
+            std::uint64_t frame_serial = 0;
+            // Drawn over the backdrop quad every frame until clear()
+            rect_batch rects;
             const std::vector<vertex> vertices = {
                 {{-1.0f, -1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
                 {{ 1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
@@ -108,67 +219,59 @@ namespace si {
 
             void reset_descriptor_set_layout();
             void reset_pipeline();
+            // Looks up or builds the pipeline for a variant
+            ::vk::Pipeline get_pipeline(pipeline_variant variant);
             void reset_swapchain(std::uint32_t width, std::uint32_t height);
             void reset_swapchain_images();
+            void recreate_swapchain();
+            // The newest serial such that it and every frame before it have completed
+            std::uint64_t completed_serial();
+            // Frees retired swapchains whose frames have all completed
+            void collect_retired();
             void reset_framebuffers(std::uint32_t width, std::uint32_t height);
             void reset_vertex_buffer();
             void reset_index_buffer();
+            void reset_frames(std::uint32_t frames_in_flight);
             void reset_uniform_buffers();
             void reset_descriptor_pool();
             void reset_descriptor_sets();
-            void reset_texture_image(std::string filepath);
-            void reset_command_buffers(std::uint32_t width, std::uint32_t height);
-
-            void update_uniform_buffers(unsigned ix);
 
-            template<typename F>
-            void run_oneshot(F&& f) {
-                std::vector<::vk::UniqueCommandBuffer> cmds = device.logical->allocateCommandBuffersUnique({
-                    *graphics_command_pool,
-                    ::vk::CommandBufferLevel::ePrimary,
-                    1
-                });
-                ::vk::CommandBuffer& cmd = *cmds.front();
-                cmd.begin(::vk::CommandBufferBeginInfo {});
-                f(cmd);
-                cmd.end();
-                device.graphics_q.submit (
-                    ::vk::SubmitInfo {
-                        0, nullptr,
-                        nullptr,
-                        1, &cmd,
-                        0, nullptr
-                   },
-                    nullptr
-                );
-                device.graphics_q.waitIdle();
-            }
-            void copy(::vk::Buffer src, ::vk::Buffer dst, ::vk::BufferCopy what);
-            void copy(::vk::Buffer src, ::vk::Image dst, ::vk::BufferImageCopy what);
-            // These are poorly named and thought out [temporary] helper functions
-            void image_layout_stage0(::vk::Image& img, ::vk::Format format);
-            void image_layout_stage1(::vk::Image& img, ::vk::Format format);
+            // Everything drawn since the image was, or nullopt if it needs redrawing in full
+            std::optional<std::vector<::vk::Rect2D>> image_damage(std::uint32_t swapchain_image_ix) const;
+            void record_command_buffer(frame_context& frame, std::uint32_t swapchain_image_ix, const std::optional<std::vector<::vk::Rect2D>>& damage);
+            void update_uniform_buffers(frame_context& frame);
+            void update_instance_buffer(frame_context& frame);
 
-            template<typename It>
-            std::tuple<::vk::UniqueBuffer, ::vk::UniqueDeviceMemory, std::size_t> stage(const It begin, const It end) {
-                using T = typename std::iterator_traits<It>::value_type;
-                std::size_t size = sizeof(T) * std::distance(begin, end);
-                auto [buffer, buffer_memory] = device.make_buffer (
-                    size,
-                    ::vk::BufferUsageFlagBits::eTransferSrc,
-                    ::vk::SharingMode::eExclusive,
-                    ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
-                );
-                void* data = device.logical->mapMemory(*buffer_memory, 0, size);
-                std::copy(begin, end, reinterpret_cast<T*>(data));
-                device.logical->unmapMemory(*buffer_memory);
-                return std::make_tuple(std::move(buffer), std::move(buffer_memory), size);
-            }
+            void reset_offscreen_images();
+            // Copies the frame's image into its readback buffer once rendered
+            void record_readback(frame_context& frame, std::uint32_t image_ix);
 
-            renderer(gfx_device& device, ::vk::UniqueSurfaceKHR surface, std::uint32_t width, std::uint32_t height);
+            renderer(gfx_device& device, ::vk::UniqueSurfaceKHR surface, std::uint32_t width, std::uint32_t height, present_policy policy, std::uint32_t frames_in_flight, bool readback = false);
             ~renderer();
-            void draw();
+            // Returns false without drawing if nothing has changed since the last frame
+            bool draw();
+            // Whether draw() has anything to do, so idle windows needn't ask for frames at all
+            bool needs_redraw() const;
+            // Loads an image for rects to sample; frames wait for it to finish uploading
+            si::texture_region load_texture(std::string filepath);
+            // Loads an image in the background; draw the stream's current region
+            // with streamed_region(), the placeholder until the image is uploaded
+            std::uint32_t stream_texture(std::string filepath);
+            si::texture_region streamed_region(std::uint32_t stream) const;
+            // Calls wake, from another thread, when a streamed texture has
+            // decoded and draw() has uploading to do
+            void wake_on_decode(std::function<void()> wake);
+            void add_rect(const si::rect& r);
+            void add_text(const si::text& t);
+            // Starts a new scene, forgetting every rect and text added so far
+            void clear();
+            // Marks an area, or the whole window, for redrawing. Changes to rects are found automatically.
+            void invalidate();
+            void invalidate(::vk::Rect2D area);
             void resize(std::uint32_t width, std::uint32_t height);
+            bool headless() const;
+            // Waits for the last frame drawn and returns its pixels; needs a headless renderer made with readback
+            frame_pixels read_pixels();
         };
     }
 }
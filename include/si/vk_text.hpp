@@ -0,0 +1,118 @@
+#ifndef SI_VK_TEXT_HPP_INCLUDED
+#define SI_VK_TEXT_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <si/vk_texture.hpp>
+#include <si/vk_upload.hpp>
+#include <si/vk_batch.hpp>
+#include <si/ui.hpp>
+#include <si/font.hpp>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace si {
+    namespace vk {
+        struct cached_glyph {
+            si::texture_region region;
+            std::int32_t left; // from the pen position to the bitmap's left edge
+            std::int32_t top;  // from the baseline up to the bitmap's top edge
+            std::uint32_t width;
+            std::uint32_t height;
+            std::size_t shelf;
+        };
+        struct shaping_key {
+            std::string content;
+            std::uint32_t face;
+            std::uint32_t size;
+            auto operator<=>(const shaping_key&) const = default;
+        };
+
+        struct text_stats {
+            std::uint64_t glyph_hits = 0;
+            std::uint64_t glyph_misses = 0;   // rasterized and uploaded
+            std::uint64_t shelf_evictions = 0;
+            std::uint64_t glyphs_dropped = 0; // atlas full of glyphs the current scene uses
+            std::uint64_t shaping_hits = 0;
+            std::uint64_t shaping_misses = 0;
+        };
+
+        // Glyph coverage in a single channel atlas page, packed into shelves.
+        // When it fills up, the least recently used shelf is emptied, but never
+        // one holding glyphs that a frame still in flight might draw. New
+        // glyphs are uploaded together, so a cold paragraph costs one copy
+        // and one barrier rather than one of each per glyph.
+        class glyph_atlas {
+            struct shelf {
+                std::uint32_t y;
+                std::uint32_t height;
+                std::uint32_t used_width = 0;
+                std::uint64_t last_scene = 0;
+                std::vector<glyph_key> glyphs;
+            };
+            struct pending_copy {
+                ::vk::Offset2D at;
+                std::uint32_t width;
+                std::uint32_t height;
+                std::size_t offset; // into pending_coverage
+            };
+            uploader& uploads;
+            coverage_page page;
+            std::vector<shelf> shelves;
+            std::uint32_t used_height = 0;
+            std::map<glyph_key, cached_glyph> glyphs;
+            text_stats& counters;
+            upload latest;
+            std::vector<unsigned char> pending_coverage; // of glyphs inserted since the last flush, packed
+            std::vector<pending_copy> pending;
+
+            std::optional<std::size_t> make_room(std::uint32_t w, std::uint32_t h, std::uint64_t scene, std::uint64_t evictable);
+        public:
+            static constexpr std::uint32_t size = 1024;
+
+            glyph_atlas(texture_manager& textures, uploader& uploads, text_stats& counters);
+            const cached_glyph* find(const glyph_key& key, std::uint64_t scene);
+            // Places an 8 bit coverage bitmap, to be uploaded by the next
+            // flush(); nullptr if there's no room for it
+            const cached_glyph* insert(const glyph_key& key, const unsigned char* coverage, std::uint32_t width, std::uint32_t height, std::int32_t pitch, std::int32_t left, std::int32_t top, std::uint64_t scene, std::uint64_t evictable);
+            // Uploads every glyph inserted since the last flush with one copy and one barrier
+            void flush();
+            // Completes once every glyph inserted so far can be sampled
+            upload ready() const;
+        };
+
+        // Shapes text with the font library and emits a textured rect per glyph, so text
+        // batches with everything else. Runs are shaped once per string, font
+        // and size; glyphs are rasterized once until evicted from the atlas.
+        class text_renderer {
+            font_library fonts;
+            std::map<shaping_key, shaped_run> runs;
+            text_stats counters;
+            glyph_atlas atlas;
+            std::uint64_t scene = 1;
+            std::uint64_t evictable = 0;           // scenes up to this are no longer drawn by any frame
+            std::deque<std::pair<std::uint64_t, std::uint64_t>> ended; // scene, last frame serial that drew it
+
+            const shaped_run& shape(const si::text& t, std::uint32_t face);
+        public:
+            static constexpr std::size_t max_runs = 4096; // shaping cache is dropped wholesale beyond this
+
+            text_renderer(texture_manager& textures, uploader& uploads);
+            text_renderer(const text_renderer&) = delete;
+            void add(rect_batch& batch, const si::text& t);
+            // The scene being built is now drawn by frames up to last_serial
+            void end_scene(std::uint64_t last_serial);
+            // Lets glyphs of scenes that finished drawing by completed_serial be evicted
+            void collect(std::uint64_t completed_serial);
+            upload ready() const;
+            const text_stats& stats() const;
+        };
+    }
+}
+
+#endif
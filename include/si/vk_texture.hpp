@@ -0,0 +1,163 @@
+#ifndef SI_VK_TEXTURE_HPP_INCLUDED
+#define SI_VK_TEXTURE_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <si/vk_allocator.hpp>
+#include <si/vk_upload.hpp>
+#include <si/ui.hpp>
+#include <si/thread_pool.hpp>
+#include <vector>
+#include <string>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+struct FIBITMAP;
+
+namespace si {
+    namespace vk {
+        struct gfx_device;
+
+        struct freeimage_deleter {
+            void operator()(FIBITMAP*) const;
+        };
+
+        // Packs rectangles into rows ("shelves") of a fixed-size page, choosing
+        // the shortest shelf an image fits on before opening a new one.
+        class shelf_packer {
+            struct shelf {
+                std::uint32_t y;
+                std::uint32_t height;
+                std::uint32_t used_width;
+            };
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint32_t used_height = 0;
+            std::vector<shelf> shelves;
+        public:
+            shelf_packer(std::uint32_t width, std::uint32_t height);
+            std::optional<::vk::Offset2D> pack(std::uint32_t w, std::uint32_t h);
+        };
+
+        struct texture {
+            ::vk::UniqueImage image;
+            allocation memory;
+            ::vk::UniqueImageView view;
+            ::vk::Extent2D extent;
+        };
+        struct atlas_page {
+            texture tex;
+            shelf_packer packer;
+            std::uint32_t slot;
+        };
+        struct image_level {
+            std::size_t offset; // into decoded_image::contents
+            std::size_t length;
+        };
+        // An image read from a file and ready to stage, mips included. Made off
+        // the render thread; only uploading it needs the Vulkan objects.
+        struct decoded_image {
+            ::vk::Format format;
+            std::uint32_t width;
+            std::uint32_t height;
+            // If set, level 0 as FreeImage decoded it, which staging converts
+            // straight into the mapped buffer; levels then starts at level 1.
+            std::unique_ptr<FIBITMAP, freeimage_deleter> bitmap;
+            std::vector<std::byte> contents;
+            std::vector<image_level> levels; // largest first
+            std::uint32_t level_count() const {
+                return levels.size() + (bitmap ? 1 : 0);
+            }
+        };
+        // KTX2 files keep their mips and block compression; anything else is
+        // decoded with FreeImage, and given mips if too big to share a page.
+        decoded_image decode_image(const std::string& filepath, std::uint32_t max_atlased);
+
+        // A single channel image, in the general layout, that samples as
+        // (1, 1, 1, coverage) so it can tint whatever colour it's drawn with.
+        struct coverage_page {
+            std::uint32_t slot;
+            ::vk::Image image;
+        };
+
+        // Every texture the renderer samples, in one descriptor array so shaders
+        // pick a texture by index instead of the renderer rebinding. Small images
+        // share atlas pages; large ones get a slot of their own, and mipmaps,
+        // since mips of a page would bleed neighbouring images into each other.
+        class texture_manager {
+            // A texture loading in the background, drawn as the placeholder until it's resident
+            struct stream {
+                si::texture_region region;
+                std::optional<si::texture_region> arriving;
+                upload uploaded;
+                bool resident = false; // or failed to load, so stays the placeholder
+            };
+            gfx_device& device;
+            uploader& uploads;
+            ::vk::UniqueSampler sampler;
+            ::vk::UniqueDescriptorSetLayout layout;
+            ::vk::UniqueDescriptorPool pool;
+            ::vk::DescriptorSet set; // destroyed along with the pool
+            std::vector<atlas_page> pages;
+            std::vector<texture> singles;
+            std::uint32_t next_slot = 0;
+            upload latest;
+            si::texture_region placeholder;
+            std::vector<stream> streams;
+            std::mutex decoded_mutex;
+            std::vector<std::pair<std::uint32_t, decoded_image>> decoded; // by stream, waiting to be uploaded
+            std::function<void()> decoded_notify; // guarded by decoded_mutex
+            thread_pool decoders; // last, so it's joined before anything its tasks touch goes away
+
+            texture make_texture(::vk::Extent2D extent, ::vk::ImageLayout layout, ::vk::Format format, ::vk::ComponentMapping components = {}, std::uint32_t levels = 1);
+            std::uint32_t bind(const texture& tex, ::vk::ImageLayout layout);
+            // Writes one of the image's levels into the staging ring
+            staging_region stage_level(const decoded_image& image, std::uint32_t level);
+            // Copies width * height staged BGRA texels into a page with room for them
+            si::texture_region add_atlased(std::uint32_t width, std::uint32_t height, const staging_region& staged);
+            // A texture of its own, with however many levels the image has
+            si::texture_region add_single(const decoded_image& image);
+        public:
+            static constexpr std::uint32_t max_textures = 256; // keep in step with the shaders' textures[]
+            static constexpr std::uint32_t page_size = 2048;
+            static constexpr std::uint32_t max_atlased = 256;  // largest side that goes into a page
+            static constexpr std::uint32_t padding = 1;        // texels between atlased images, against filtering bleed
+            static constexpr std::size_t decode_threads = 2;
+
+            texture_manager(gfx_device& device, uploader& uploads);
+            texture_manager(const texture_manager&) = delete;
+            // Copies width * height BGRA texels into a page, or a texture of their own with mips.
+            si::texture_region add(std::uint32_t width, std::uint32_t height, const std::byte* bgra);
+            si::texture_region add(const decoded_image& image);
+            // Decodes and uploads before returning
+            si::texture_region add(std::string filepath);
+            // Decodes in the background instead, returning a stream whose region
+            // is the placeholder until the texture has been uploaded.
+            std::uint32_t add_streamed(std::string filepath);
+            si::texture_region region(std::uint32_t stream) const;
+            // Uploads whatever has been decoded, and swaps in whatever has
+            // finished uploading. Returns whether any stream's region changed.
+            bool update();
+            // Whether any stream is still decoding or uploading
+            bool streaming() const;
+            // Calls notify, on a decode thread, whenever an image is ready for
+            // update(); e.g. to wake an event loop. Called once straight away
+            // if any already are.
+            void notify_decoded(std::function<void()> notify);
+            // Whether images of the format can be copied into and sampled
+            bool can_sample(::vk::Format format) const;
+            // An empty page for a caller that packs and uploads into it itself
+            coverage_page add_coverage(::vk::Extent2D extent);
+            // Completes once everything added so far can be sampled
+            upload ready() const;
+            ::vk::DescriptorSetLayout set_layout() const;
+            ::vk::DescriptorSet descriptor_set() const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef SI_VK_UPLOAD_HPP_INCLUDED
+#define SI_VK_UPLOAD_HPP_INCLUDED
+
+#include <vulkan/vulkan.hpp>
+#include <si/vk_allocator.hpp>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+namespace si {
+    namespace vk {
+        struct gfx_device;
+        class uploader;
+
+        // Future-like handle to work recorded by the uploader. Batches complete
+        // in submission order, so a handle is just the value of its batch.
+        class upload {
+            uploader* owner = nullptr;
+            std::uint64_t value = 0;
+        public:
+            upload() = default; // already complete
+            upload(uploader* owner, std::uint64_t value);
+            bool ready() const;
+            void wait() const;
+            // Later uploads from the same uploader compare greater
+            auto operator<=>(const upload&) const = default;
+        };
+
+        struct upload_batch {
+            ::vk::UniqueCommandBuffer cmd;
+            ::vk::UniqueFence fence;
+            std::uint64_t value = 0;
+            std::optional<::vk::DeviceSize> ring_end; // where the staging ring's tail moves to once this completes
+            std::vector<::vk::UniqueBuffer> retired_buffers;
+            std::vector<allocation> retired_memories;
+        };
+
+        // Host-visible memory that a copy can read from. Usually a slice of the
+        // staging ring; only oversized uploads get a buffer of their own.
+        struct staging_region {
+            ::vk::Buffer buffer;
+            ::vk::DeviceSize offset;
+            ::vk::DeviceSize size;
+            std::byte* data;
+        };
+
+        struct upload_stats {
+            std::uint64_t ring_uploads = 0;
+            std::uint64_t ring_bytes = 0;
+            std::uint64_t ring_stalls = 0;        // times stage() had to wait for the GPU to free ring space
+            std::uint64_t oversized_uploads = 0;  // fell back to a temporary buffer
+            std::uint64_t objects_created = 0;    // Vulkan objects created after construction
+        };
+
+        // Records copies and layout transitions into one command buffer and
+        // submits them together on the transfer queue, instead of stalling the
+        // graphics queue once per operation.
+        class uploader {
+            gfx_device& device;
+            ::vk::UniqueCommandPool command_pool;
+            std::unique_ptr<upload_batch> recording;
+            std::deque<std::unique_ptr<upload_batch>> submitted;
+            std::vector<std::unique_ptr<upload_batch>> spare;
+            std::uint64_t next_value = 1;
+            std::uint64_t completed_value = 0;
+            ::vk::UniqueBuffer ring;
+            allocation ring_memory;
+            ::vk::DeviceSize ring_head = 0;
+            ::vk::DeviceSize ring_tail = 0;
+            std::size_t ring_holders = 0; // batches, recording or submitted, that own part of the ring
+            ::vk::DeviceSize ring_alignment;
+            upload_stats counters;
+            // Only with a separate transfer family: semaphores signalled by
+            // submitted batches that no graphics submit waits on yet, those
+            // waited on by the graphics submit with the paired frame serial,
+            // and those free to be signalled again
+            std::vector<::vk::UniqueSemaphore> signalled;
+            std::deque<std::pair<std::uint64_t, ::vk::UniqueSemaphore>> awaited;
+            std::vector<::vk::UniqueSemaphore> idle_semaphores;
+
+            upload_batch& current();
+            std::optional<::vk::DeviceSize> ring_take(::vk::DeviceSize size);
+        public:
+            static constexpr ::vk::DeviceSize ring_capacity = 16 * 1024 * 1024;
+
+            explicit uploader(gfx_device& device);
+            uploader(const uploader&) = delete;
+            ~uploader();
+            upload copy(::vk::Buffer src, ::vk::Buffer dst, ::vk::BufferCopy what);
+            upload copy(::vk::Buffer src, ::vk::Image dst, ::vk::BufferImageCopy what, ::vk::ImageLayout dst_layout = ::vk::ImageLayout::eTransferDstOptimal);
+            // Many regions of one image in a single command, e.g. a batch of glyphs
+            upload copy(::vk::Buffer src, ::vk::Image dst, const std::vector<::vk::BufferImageCopy>& what, ::vk::ImageLayout dst_layout = ::vk::ImageLayout::eTransferDstOptimal);
+            // Moves an image from undefined into a layout copies can write to, or
+            // from there into a layout shaders can sample. General to general
+            // just makes copies into a general image visible to shaders.
+            upload transition(::vk::Image img, ::vk::ImageLayout from, ::vk::ImageLayout to, std::uint32_t levels = 1);
+            // Keeps a staging resource alive until the batch reading from it has completed.
+            void retire(::vk::UniqueBuffer buffer, allocation memory);
+            // Reserves host-visible memory for the next copy recorded into the current batch.
+            staging_region stage(::vk::DeviceSize size);
+            template<typename It>
+            staging_region stage(const It begin, const It end) {
+                using T = typename std::iterator_traits<It>::value_type;
+                staging_region region = stage(sizeof(T) * std::distance(begin, end));
+                std::copy(begin, end, reinterpret_cast<T*>(region.data));
+                return region;
+            }
+            const upload_stats& stats() const;
+            // Submits everything recorded so far, if anything.
+            void flush();
+            // Reclaims finished batches; returns the latest completed value.
+            std::uint64_t collect();
+            void wait(std::uint64_t value);
+            // Semaphores the graphics submit with frame serial serial has to
+            // wait on before reading vertices or sampling, so it sees what the
+            // transfer queue wrote; empty when uploads run on the graphics family.
+            std::vector<::vk::Semaphore> take_waits(std::uint64_t serial);
+            // Recycles the semaphores waited on by graphics submits up to completed_serial.
+            void collect_waits(std::uint64_t completed_serial);
+        };
+    }
+}
+
+#endif
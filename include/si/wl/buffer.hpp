@@ -3,6 +3,7 @@
 
 #include <wayland-client.h>
 #include <memory>
+#include <boost/signals2/signal.hpp>
 
 namespace wl {
     struct buffer_deleter {
@@ -10,10 +11,14 @@ namespace wl {
     };
     class buffer {
         std::unique_ptr<wl_buffer, buffer_deleter> const hnd;
+        static void dispatch_release(void* data, wl_buffer* buffer);
+        wl_buffer_listener listener { dispatch_release };
     public:
         explicit buffer(wl_buffer*);
         buffer(const buffer&) = delete;
         explicit operator wl_buffer*() const;
+        // The compositor has finished reading the buffer, so it can be drawn into again
+        boost::signals2::signal<void()> on_release;
     };
 }
 
@@ -20,6 +20,15 @@ namespace wl {
         registry make_registry();
         int dispatch();
         int flush();
+        // For waiting on with an event loop, instead of dispatch() blocking:
+        // prepare_read(), wait for fd() to be readable, then read_events() and
+        // dispatch_pending(), or cancel_read() if something else woke the loop.
+        int fd();
+        // False if events are already queued; dispatch_pending() them first
+        bool prepare_read();
+        void read_events();
+        void cancel_read();
+        int dispatch_pending();
         void roundtrip();
         EGLDisplay egl();
     };
@@ -16,6 +16,8 @@ namespace wl {
         explicit shm_pool(wl_shm_pool*);
         explicit operator wl_shm_pool*() const;
         buffer make_buffer(std::int32_t offset, std::int32_t width, std::int32_t height, std::int32_t stride, std::int32_t format);
+        // Pools can only grow, and the compositor remaps the file to the new size
+        void resize(std::int32_t size);
     };
 }
 
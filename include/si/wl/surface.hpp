@@ -20,6 +20,8 @@ namespace wl {
         explicit surface(wl_surface*);
         explicit operator wl_surface*() const;
         void attach(buffer& buf, std::int32_t x, std::int32_t y);
+        // In buffer pixels; what's outside it may be left as it was last commit
+        void damage_buffer(std::int32_t x, std::int32_t y, std::int32_t width, std::int32_t height);
         void commit();
         void frame(boost::signals2::signal<void(std::chrono::milliseconds)>& signal);
     };
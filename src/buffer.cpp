@@ -8,6 +8,10 @@ wl::buffer::buffer(wl_buffer* buffer) : hnd(buffer) {
     if (!hnd) {
         throw std::runtime_error("Can't create buffer from nullptr");
     }
+    wl_buffer_add_listener(hnd.get(), &listener, this);
+}
+void wl::buffer::dispatch_release(void* data, wl_buffer* buffer) {
+    reinterpret_cast<wl::buffer*>(data)->on_release();
 }
 
 wl::buffer::operator wl_buffer*() const {
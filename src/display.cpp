@@ -1,6 +1,8 @@
 #include <si/wl/display.hpp>
 #include <si/egl.hpp>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <spdlog/spdlog.h>
 
 void wl::display_deleter::operator()(wl_display* dpy) const {
@@ -27,8 +29,32 @@ int wl::display::dispatch() {
 }
 int wl::display::flush() {
     int count = wl_display_flush(hnd.get());
+    // EAGAIN only means the socket is full; the caller waits for it to drain
+    if (count == -1 && errno != EAGAIN) {
+        const int error = errno;
+        spdlog::error("Can't flush requests: {}", std::strerror(error));
+        errno = error;
+    }
+    return count;
+}
+int wl::display::fd() {
+    return wl_display_get_fd(hnd.get());
+}
+bool wl::display::prepare_read() {
+    return wl_display_prepare_read(hnd.get()) == 0;
+}
+void wl::display::read_events() {
+    if (wl_display_read_events(hnd.get()) == -1) {
+        throw std::runtime_error("Reading events failed!");
+    }
+}
+void wl::display::cancel_read() {
+    wl_display_cancel_read(hnd.get());
+}
+int wl::display::dispatch_pending() {
+    int count = wl_display_dispatch_pending(hnd.get());
     if (count == -1) {
-        spdlog::error("No events to flush");
+        throw std::runtime_error("Dispatch failed!");
     }
     return count;
 }
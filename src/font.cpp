@@ -0,0 +1,93 @@
+#include <si/font.hpp>
+#include <si/util.hpp>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_ADVANCES_H
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <stdexcept>
+
+void si::ft_library_deleter::operator()(FT_LibraryRec_* library) const {
+    FT_Done_FreeType(library);
+}
+void si::ft_face_deleter::operator()(FT_FaceRec_* face) const {
+    FT_Done_Face(face);
+}
+
+si::font_library::font_library() {
+    FT_Library lib;
+    if (FT_Error e = FT_Init_FreeType(&lib); e != 0) {
+        throw std::runtime_error(fmt::format("Couldn't initialise FreeType: {}", e));
+    }
+    library.reset(lib);
+}
+std::uint32_t si::font_library::face(const std::string& path) {
+    if (auto it = face_ids.find(path); it != face_ids.end()) {
+        return it->second;
+    }
+    FT_Face face;
+    if (FT_Error e = FT_New_Face(library.get(), path.c_str(), 0, &face); e != 0) {
+        throw std::runtime_error(fmt::format("Couldn't load font {}: {}", path, e));
+    }
+    spdlog::info("Loaded font {} ({} {})", path, face->family_name ? face->family_name : "?", face->style_name ? face->style_name : "?");
+    faces.emplace_back(face);
+    return face_ids.emplace(path, faces.size() - 1).first->second;
+}
+si::shaped_run si::font_library::shape(const std::string& content, std::uint32_t face, std::uint32_t size) {
+    FT_Face ft = faces[face].get();
+    FT_Set_Pixel_Sizes(ft, 0, size);
+    shaped_run run { .glyphs = {}, .advance = 0, .ascender = static_cast<std::int32_t>(ft->size->metrics.ascender >> 6) };
+    FT_UInt previous = 0;
+    for (auto it = content.cbegin(); it != content.cend();) {
+        const FT_UInt glyph = FT_Get_Char_Index(ft, si::next_code_point(it, content.cend()));
+        if (previous && FT_HAS_KERNING(ft)) {
+            FT_Vector kerning;
+            FT_Get_Kerning(ft, previous, glyph, FT_KERNING_DEFAULT, &kerning);
+            run.advance += kerning.x >> 6;
+        }
+        run.glyphs.push_back(shaped_glyph { .glyph = glyph, .x = run.advance });
+        FT_Fixed advance = 0;
+        FT_Get_Advance(ft, glyph, FT_LOAD_DEFAULT, &advance);
+        run.advance += advance >> 16;
+        previous = glyph;
+    }
+    return run;
+}
+std::optional<si::glyph_coverage> si::font_library::render(const glyph_key& key) {
+    FT_Face ft = faces[key.face].get();
+    FT_Set_Pixel_Sizes(ft, 0, key.size);
+    if (FT_Load_Glyph(ft, key.glyph, FT_LOAD_RENDER) != 0) {
+        return std::nullopt;
+    }
+    const FT_Bitmap& bitmap = ft->glyph->bitmap;
+    glyph_coverage c {
+        .left = ft->glyph->bitmap_left,
+        .top = ft->glyph->bitmap_top,
+        .width = bitmap.width,
+        .height = bitmap.rows,
+        .pitch = bitmap.pitch,
+        .pixels = bitmap.buffer
+    };
+    // FT_LOAD_RENDER gives 8 bit coverage, except for fonts with embedded
+    // bitmap strikes, whose glyphs come as 1 bit masks, most significant
+    // bit first. Those are widened.
+    if (bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+        widened.resize(std::size_t{bitmap.width} * bitmap.rows);
+        for (std::uint32_t y = 0; y < bitmap.rows; y++) {
+            const unsigned char* row = bitmap.buffer + std::ptrdiff_t{bitmap.pitch} * y;
+            for (std::uint32_t x = 0; x < bitmap.width; x++) {
+                widened[std::size_t{y} * bitmap.width + x] = (row[x >> 3] >> (7 - (x & 7))) & 1 ? 0xff : 0;
+            }
+        }
+        c.pitch = static_cast<std::int32_t>(bitmap.width);
+        c.pixels = widened.data();
+    } else if (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY) {
+        if (bitmap.width > 0 && bitmap.rows > 0) {
+            spdlog::warn("Glyph {} of {} is in pixel mode {}, which isn't supported", key.glyph, ft->family_name ? ft->family_name : "?", bitmap.pixel_mode);
+        }
+        c.width = 0;
+        c.height = 0;
+        c.pixels = nullptr;
+    }
+    return c;
+}
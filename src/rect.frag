@@ -0,0 +1,32 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Sized to texture_manager::max_textures
+layout(set = 1, binding = 0) uniform sampler2D textures[256];
+
+layout(constant_id = 0) const bool textured = false;
+// rect_instance::untextured: drawn in the same batch as textured rects, to keep their order
+const uint untextured = 0xffffffffu;
+
+layout(location = 0) in vec4 fragColour;
+layout(location = 1) in vec4 fragBorderColour;
+layout(location = 2) in vec2 fragUv;
+layout(location = 3) in vec2 fragLocal;
+layout(location = 4) flat in vec3 fragSizeBorder;
+layout(location = 5) flat in uint fragTexture;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec2 edge = min(fragLocal, fragSizeBorder.xy - fragLocal);
+    vec4 colour = fragColour;
+    if (textured && fragTexture != untextured) {
+        // Instances in one draw can each use a different texture
+        colour *= texture(textures[nonuniformEXT(fragTexture)], fragUv);
+    }
+    if (min(edge.x, edge.y) < fragSizeBorder.z) {
+        colour = fragBorderColour;
+    }
+    outColor = colour;
+}
@@ -0,0 +1,40 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+  mat4 view;
+  mat4 proj;
+} ubo;
+
+// Maps pixels to clip space
+layout(push_constant) uniform PushConstants {
+  mat4 model;
+} pc;
+
+layout(location = 0) in vec4 inBounds;
+layout(location = 1) in vec4 inUv;
+// 0xAARRGGBB, so read with blue first
+layout(location = 2) in vec4 inColour;
+layout(location = 3) in vec4 inBorderColour;
+layout(location = 4) in float inBorderWidth;
+layout(location = 5) in uint inTexture;
+
+layout(location = 0) out vec4 fragColour;
+layout(location = 1) out vec4 fragBorderColour;
+layout(location = 2) out vec2 fragUv;
+layout(location = 3) out vec2 fragLocal;
+layout(location = 4) flat out vec3 fragSizeBorder;
+layout(location = 5) flat out uint fragTexture;
+
+void main() {
+  // Indices 0..3 walk the corners of the unit quad
+  vec2 corner = vec2(gl_VertexIndex == 1 || gl_VertexIndex == 2, gl_VertexIndex >= 2);
+  vec2 pos = inBounds.xy + corner * inBounds.zw;
+  gl_Position = ubo.proj * ubo.view * pc.model * vec4(pos, 0.0, 1.0);
+  fragColour = inColour.bgra;
+  fragBorderColour = inBorderColour.bgra;
+  fragUv = mix(inUv.xy, inUv.zw, corner);
+  fragLocal = corner * inBounds.zw;
+  fragSizeBorder = vec3(inBounds.zw, inBorderWidth);
+  fragTexture = inTexture;
+}
@@ -1,7 +1,18 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+// Sized to texture_manager::max_textures
+layout(set = 1, binding = 0) uniform sampler2D textures[256];
+
+layout(push_constant) uniform PushConstants {
+  mat4 model;
+  vec4 region;
+  uint texture;
+} pc;
+
+// Pipeline variants; the compiler drops whichever branches are disabled.
+layout(constant_id = 0) const bool textured = true;
+layout(constant_id = 1) const bool coloured = false;
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragUv;
@@ -9,6 +20,13 @@ layout(location = 1) in vec2 fragUv;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragUv);
+    vec4 colour = vec4(1.0);
+    if (coloured) {
+        colour *= vec4(fragColor, 1.0);
+    }
+    if (textured) {
+        colour *= texture(textures[pc.texture], pc.region.xy + fragUv * pc.region.zw);
+    }
+    outColor = colour;
 }
 
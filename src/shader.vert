@@ -2,11 +2,14 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-  mat4 model;
   mat4 view;
   mat4 proj;
 } ubo;
 
+layout(push_constant) uniform PushConstants {
+  mat4 model;
+} pc;
+
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inUv;
@@ -15,7 +18,7 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragUv;
 
 void main() {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
+  gl_Position = ubo.proj * ubo.view * pc.model * vec4(inPosition, 0.0, 1.0);
   fragColor = inColor;
   fragUv = inUv;
 }
@@ -1,20 +1,166 @@
 #include <si/shm_buffer.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-namespace ipc = boost::interprocess;
+namespace {
+    std::runtime_error errno_error(const char* what) {
+        return std::runtime_error(fmt::format("{}: {}", what, std::strerror(errno)));
+    }
+    std::size_t buffer_size(std::int32_t width, std::int32_t height) {
+        return std::size_t(width) * height * bytes_per_pixel;
+    }
+    // Neither the pool nor a buffer may be empty, so a 0x0 window gets 1x1 buffers
+    std::int32_t at_least_one(std::int32_t extent) {
+        return std::max(extent, 1);
+    }
+    std::size_t initial_size(std::int32_t width, std::int32_t height) {
+        return shm_swapchain::min_buffers * buffer_size(at_least_one(width), at_least_one(height));
+    }
+}
+
+shm_file::shm_file(std::size_t size) : fd(memfd_create("si-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING)) {
+    if (fd < 0) {
+        throw errno_error("Can't create shm file");
+    }
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        throw errno_error("Can't size shm file");
+    }
+    // The compositor maps the file too; it mustn't shrink from under it.
+    // Growing is still allowed, for resizing the pool.
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+        close(fd);
+        throw errno_error("Can't seal shm file");
+    }
+}
+shm_file::~shm_file() {
+    close(fd);
+}
+
+shm_mapping::shm_mapping(const shm_file& file, std::size_t size) :
+    data(static_cast<std::byte*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0))),
+    size(size)
+    {
+    if (data == MAP_FAILED) {
+        throw errno_error("Can't map shm file");
+    }
+}
+shm_mapping::~shm_mapping() {
+    munmap(data, size);
+}
+void shm_mapping::grow(const shm_file& file, std::size_t new_size) {
+    if (ftruncate(file.fd, new_size) < 0) {
+        throw errno_error("Can't grow shm file");
+    }
+    void* moved = mremap(data, size, new_size, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+        throw errno_error("Can't remap shm file");
+    }
+    data = static_cast<std::byte*>(moved);
+    size = new_size;
+}
 
-ipc::shared_memory_object shm_buffer::make_shm_obj(int width, int height) {
-    ipc::shared_memory_object shm_obj {
-        ipc::open_or_create,
-        "foobar",
-        ipc::read_write
-    };
-    shm_obj.truncate(width * height * bytes_per_pixel);
-    return shm_obj;
-}
-shm_buffer::shm_buffer(wl::shm& shm_iface, int width, int height) :
-    shm_obj{make_shm_obj(width, height)},
-    pixels{shm_obj, ipc::read_write},
-    pool{shm_iface.make_pool(shm_obj.get_mapping_handle().handle, pixels.get_size())},
-    buffer(pool.make_buffer(0, width, height, width * bytes_per_pixel, WL_SHM_FORMAT_ARGB8888))
+shm_buffer::shm_buffer(wl::shm_pool& pool, std::uint64_t id, std::int32_t offset, std::int32_t width, std::int32_t height, std::uint32_t* pixels) :
+    id(id),
+    offset(offset),
+    width(width),
+    height(height),
+    pixels(pixels),
+    buffer(pool.make_buffer(offset, width, height, width * bytes_per_pixel, WL_SHM_FORMAT_ARGB8888))
     {
+    buffer.on_release.connect([this]() { busy = false; });
+}
+std::size_t shm_buffer::size() const {
+    return buffer_size(width, height);
+}
+
+shm_swapchain::shm_swapchain(wl::shm& shm, std::int32_t width, std::int32_t height) :
+    file(initial_size(width, height)),
+    mapping(file, initial_size(width, height)),
+    pool(shm.make_pool(file.fd, static_cast<std::int32_t>(mapping.size))),
+    width(at_least_one(width)),
+    height(at_least_one(height))
+    {
+    for (std::size_t i = 0; i < min_buffers; i++) {
+        add_buffer();
+    }
+}
+std::size_t shm_swapchain::place(std::size_t size) const {
+    std::vector<std::pair<std::size_t, std::size_t>> used;
+    for (const auto& b : buffers) {
+        used.emplace_back(b->offset, b->offset + b->size());
+    }
+    std::sort(used.begin(), used.end());
+    std::size_t at = 0;
+    for (const auto& [begin, end] : used) {
+        if (begin >= at && begin - at >= size) {
+            break;
+        }
+        at = std::max(at, end);
+    }
+    return at;
+}
+void shm_swapchain::grow(std::size_t size) {
+    mapping.grow(file, size);
+    for (auto& b : buffers) {
+        b->pixels = reinterpret_cast<std::uint32_t*>(mapping.data + b->offset);
+    }
+    pool.resize(static_cast<std::int32_t>(mapping.size));
+    spdlog::debug("Grew shm pool to {} bytes", mapping.size);
+}
+shm_buffer& shm_swapchain::add_buffer() {
+    const std::size_t size = buffer_size(width, height);
+    const std::size_t offset = place(size);
+    if (offset + size > mapping.size) {
+        // Doubling keeps the number of resizes logarithmic in the window size
+        grow(std::max(offset + size, mapping.size * 2));
+    }
+    auto pixels = reinterpret_cast<std::uint32_t*>(mapping.data + offset);
+    return *buffers.emplace_back(std::make_unique<shm_buffer>(pool, next_id++, static_cast<std::int32_t>(offset), width, height, pixels));
+}
+shm_buffer* shm_swapchain::acquire() {
+    std::erase_if(buffers, [](const auto& b) { return b->stale && !b->busy; });
+    std::size_t live = 0;
+    for (auto& b : buffers) {
+        if (b->stale) {
+            continue;
+        }
+        if (!b->busy) {
+            return b.get();
+        }
+        live++;
+    }
+    if (live >= max_buffers) {
+        return nullptr;
+    }
+    return &add_buffer();
+}
+void shm_swapchain::present(wl::surface& surface, shm_buffer& buffer, const std::vector<shm_damage>& damage) {
+    surface.attach(buffer.buffer, 0, 0);
+    if (damage.empty()) {
+        surface.damage_buffer(0, 0, buffer.width, buffer.height);
+    }
+    for (const shm_damage& d : damage) {
+        surface.damage_buffer(d.x, d.y, d.width, d.height);
+    }
+    surface.commit();
+    buffer.busy = true;
+}
+void shm_swapchain::resize(std::int32_t new_width, std::int32_t new_height) {
+    if (at_least_one(new_width) == width && at_least_one(new_height) == height) {
+        return;
+    }
+    width = at_least_one(new_width);
+    height = at_least_one(new_height);
+    for (auto& b : buffers) {
+        b->stale = true;
+    }
+    std::erase_if(buffers, [](const auto& b) { return !b->busy; });
 }
@@ -14,3 +14,6 @@ wl::shm_pool::operator wl_shm_pool*() const {
 wl::buffer wl::shm_pool::make_buffer(std::int32_t offset, std::int32_t width, std::int32_t height, std::int32_t stride, std::int32_t format) {
     return wl::buffer{ wl_shm_pool_create_buffer(hnd.get(), offset, width, height, stride, format) };
 }
+void wl::shm_pool::resize(std::int32_t size) {
+    wl_shm_pool_resize(hnd.get(), size);
+}
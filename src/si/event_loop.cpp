@@ -0,0 +1,157 @@
+#include <si/event_loop.hpp>
+#include <fmt/format.h>
+#include <array>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+    std::runtime_error errno_error(const char* what) {
+        return std::runtime_error(fmt::format("{}: {}", what, std::strerror(errno)));
+    }
+    timespec to_timespec(std::chrono::nanoseconds d) {
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(d);
+        return timespec { .tv_sec = static_cast<time_t>(seconds.count()), .tv_nsec = static_cast<long>((d - seconds).count()) };
+    }
+}
+
+si::event_loop::event_loop() : epoll(epoll_create1(EPOLL_CLOEXEC)), wake_fd(-1) {
+    if (epoll < 0) {
+        throw errno_error("Can't create epoll instance");
+    }
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        close(epoll);
+        throw errno_error("Can't create eventfd");
+    }
+    watch(wake_fd, EPOLLIN, [this](std::uint32_t) {
+        std::uint64_t count;
+        while (read(wake_fd, &count, sizeof(count)) > 0) {
+        }
+        run_posted();
+    });
+}
+si::event_loop::~event_loop() {
+    for (const auto& [fd, t] : timers) {
+        close(fd);
+    }
+    close(wake_fd);
+    close(epoll);
+}
+void si::event_loop::watch(int fd, std::uint32_t events, std::function<void(std::uint32_t)> handler) {
+    epoll_event event { .events = events, .data = { .fd = fd } };
+    const bool watched = watches.contains(fd);
+    if (epoll_ctl(epoll, watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw errno_error("Can't watch file descriptor");
+    }
+    watches[fd] = std::move(handler);
+}
+void si::event_loop::unwatch(int fd) {
+    if (watches.erase(fd) > 0) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+int si::event_loop::add_timer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval, std::function<void()> handler) {
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        throw errno_error("Can't create timerfd");
+    }
+    // A zero it_value would disarm the timer rather than fire it right away
+    const itimerspec spec { .it_interval = to_timespec(interval), .it_value = to_timespec(std::max(delay, std::chrono::nanoseconds{1})) };
+    if (timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+        close(fd);
+        throw errno_error("Can't arm timerfd");
+    }
+    timers.emplace(fd, timer { std::move(handler), interval.count() > 0 });
+    watch(fd, EPOLLIN, [this, fd](std::uint32_t) { fire(fd); });
+    return fd;
+}
+void si::event_loop::cancel_timer(int id) {
+    if (timers.erase(id) > 0) {
+        unwatch(id);
+        close(id);
+    }
+}
+void si::event_loop::fire(int timer_fd) {
+    std::uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) <= 0) {
+        return;
+    }
+    auto it = timers.find(timer_fd);
+    if (it == timers.end()) {
+        return;
+    }
+    // Copied, since the handler may cancel its own timer
+    const std::function<void()> handler = it->second.handler;
+    if (!it->second.repeating) {
+        cancel_timer(timer_fd);
+    }
+    handler();
+}
+void si::event_loop::post(std::function<void()> task) {
+    {
+        std::lock_guard lock(posted_mutex);
+        posted.push_back(std::move(task));
+    }
+    wake();
+}
+void si::event_loop::wake() {
+    const std::uint64_t one = 1;
+    // Only fails if the counter is about to overflow, in which case the loop is awake anyway
+    [[maybe_unused]] const auto written = write(wake_fd, &one, sizeof(one));
+}
+void si::event_loop::run_posted() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard lock(posted_mutex);
+        std::swap(tasks, posted);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+std::uint32_t si::event_loop::ready_events(int fd) const {
+    return fd >= 0 && static_cast<std::size_t>(fd) < ready.size() ? ready[fd] : 0;
+}
+void si::event_loop::run() {
+    stopping = false;
+    std::array<epoll_event, 32> events;
+    while (!stopping) {
+        before_wait();
+        if (stopping) {
+            break;
+        }
+        const int count = epoll_wait(epoll, events.data(), events.size(), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw errno_error("Can't wait for events");
+        }
+        std::fill(ready.begin(), ready.end(), 0);
+        for (int i = 0; i < count; i++) {
+            const int fd = events[i].data.fd;
+            if (static_cast<std::size_t>(fd) >= ready.size()) {
+                ready.resize(fd + 1);
+            }
+            ready[fd] = events[i].events;
+        }
+        after_wait();
+        for (int i = 0; i < count; i++) {
+            // An earlier handler may have unwatched this fd, or even replaced its handler
+            auto it = watches.find(events[i].data.fd);
+            if (it == watches.end()) {
+                continue;
+            }
+            const std::function<void(std::uint32_t)> handler = it->second;
+            handler(events[i].events);
+        }
+    }
+}
+void si::event_loop::stop() {
+    stopping = true;
+}
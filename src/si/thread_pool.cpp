@@ -0,0 +1,111 @@
+#include <si/thread_pool.hpp>
+#include <algorithm>
+#include <utility>
+
+si::thread_pool::thread_pool(std::size_t workers) {
+    workers = std::max<std::size_t>(workers, 1);
+    threads.reserve(workers - 1);
+    for (std::size_t i = 1; i < workers; i++) {
+        threads.emplace_back(&thread_pool::work, this, i);
+    }
+}
+si::thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+std::size_t si::thread_pool::size() const {
+    return threads.size() + 1;
+}
+void si::thread_pool::run(const std::function<void(std::size_t, std::size_t)>& fn, std::size_t items, std::size_t worker) {
+    for (std::size_t item; (item = next_item.fetch_add(1, std::memory_order_relaxed)) < items;) {
+        try {
+            fn(item, worker);
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+void si::thread_pool::work(std::size_t worker) {
+    std::uint64_t seen = 0;
+    std::unique_lock lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || generation != seen || !tasks.empty(); });
+        if (stopping) {
+            return;
+        }
+        // A loop takes priority, since its caller is blocked until it's done.
+        // If the caller already finished it alone, job is null and we move on.
+        if (generation != seen && (seen = generation, job)) {
+            const auto* fn = job;
+            const std::size_t items = job_items;
+            busy++;
+            lock.unlock();
+            run(*fn, items, worker);
+            lock.lock();
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        } else if (!tasks.empty()) {
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            try {
+                task();
+            } catch (...) {
+            }
+            lock.lock();
+        }
+    }
+}
+void si::thread_pool::parallel_for(std::size_t items, const std::function<void(std::size_t, std::size_t)>& fn) {
+    if (items == 0) {
+        return;
+    }
+    if (items == 1 || threads.empty()) {
+        // Not worth waking anyone
+        for (std::size_t i = 0; i < items; i++) {
+            fn(i, 0);
+        }
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        job = &fn;
+        job_items = items;
+        next_item.store(0, std::memory_order_relaxed);
+        error = nullptr;
+        generation++;
+    }
+    wake.notify_all();
+    run(fn, items, 0);
+    std::exception_ptr failed;
+    {
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return busy == 0; });
+        job = nullptr;
+        failed = std::exchange(error, nullptr);
+    }
+    if (failed) {
+        std::rethrow_exception(failed);
+    }
+}
+void si::thread_pool::post(std::function<void()> task) {
+    if (threads.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
@@ -1,5 +1,9 @@
 #include <si/util.hpp>
 #include <fstream>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
 
 std::vector<std::byte> si::file_contents(std::string fname) {
     std::basic_ifstream<char> file(fname, std::ios::ate | std::ios::binary);
@@ -12,3 +16,57 @@ std::vector<std::byte> si::file_contents(std::string fname) {
         throw std::runtime_error("Couldn't open file");
     }    
 }
+void si::write_file_contents(const std::filesystem::path& fname, const std::vector<std::byte>& contents) {
+    // Write beside the target and rename over it so readers never see a partial file.
+    // The temporary is unique, so processes saving the same file at once can't mix their writes.
+    std::string tmp = fname.string() + ".XXXXXX";
+    const int fd = mkstemp(tmp.data());
+    if (fd < 0) {
+        throw std::runtime_error("Couldn't open file");
+    }
+    const std::byte* data = contents.data();
+    std::size_t left = contents.size();
+    while (left > 0) {
+        const ssize_t written = write(fd, data, left);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            close(fd);
+            unlink(tmp.c_str());
+            throw std::runtime_error("Couldn't write file");
+        }
+        data += written;
+        left -= written;
+    }
+    close(fd);
+    std::error_code error;
+    std::filesystem::rename(tmp, fname, error);
+    if (error) {
+        unlink(tmp.c_str());
+        throw std::filesystem::filesystem_error("Couldn't replace file", tmp, fname, error);
+    }
+}
+std::filesystem::path si::cache_directory() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::filesystem::path(xdg) / "si";
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "si";
+    } else {
+        throw std::runtime_error("Neither XDG_CACHE_HOME nor HOME is set");
+    }
+}
+char32_t si::next_code_point(std::string::const_iterator& it, std::string::const_iterator end) {
+    const unsigned char lead = *it++;
+    int extra = lead < 0x80 ? 0 : (lead >> 5) == 0x6 ? 1 : (lead >> 4) == 0xe ? 2 : (lead >> 3) == 0x1e ? 3 : -1;
+    if (extra < 0) {
+        return U'\uFFFD';
+    }
+    char32_t cp = extra == 0 ? lead : lead & (0x3f >> extra);
+    for (; extra > 0; extra--) {
+        if (it == end || (static_cast<unsigned char>(*it) & 0xc0) != 0x80) {
+            return U'\uFFFD';
+        }
+        cp = (cp << 6) | (static_cast<unsigned char>(*it++) & 0x3f);
+    }
+    return cp;
+}
@@ -22,6 +22,9 @@ wl::surface::operator wl_surface*() const {
 void wl::surface::attach(wl::buffer& buf, std::int32_t x, std::int32_t y) {
     wl_surface_attach(hnd.get(), static_cast<wl_buffer*>(buf), x, y);
 }
+void wl::surface::damage_buffer(std::int32_t x, std::int32_t y, std::int32_t width, std::int32_t height) {
+    wl_surface_damage_buffer(hnd.get(), x, y, width, height);
+}
 void wl::surface::commit() {
     wl_surface_commit(hnd.get());
 }
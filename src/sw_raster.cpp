@@ -0,0 +1,405 @@
+#include <si/sw_raster.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SI_SW_X86 1
+#endif
+
+namespace {
+    // Channels of two pixels at once: c * f / 255, rounded, for the channels
+    // in bits 0-7 and 16-23 of x
+    inline std::uint32_t scale_pairs(std::uint32_t x, std::uint32_t f) {
+        std::uint32_t t = (x & 0x00ff00ff) * f + 0x00800080;
+        return ((t + ((t >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    }
+    // Every channel of a premultiplied pixel times f / 255
+    inline std::uint32_t scale(std::uint32_t p, std::uint32_t f) {
+        return scale_pairs(p, f) | (scale_pairs(p >> 8, f) << 8);
+    }
+    inline std::uint32_t over(std::uint32_t s, std::uint32_t d) {
+        return s + scale(d, 255 - (s >> 24));
+    }
+    // Channel by channel product of two premultiplied pixels
+    inline std::uint32_t modulate(std::uint32_t a, std::uint32_t b) {
+        std::uint32_t out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::uint32_t t = ((a >> shift) & 0xff) * ((b >> shift) & 0xff) + 128;
+            out |= ((t + (t >> 8)) >> 8) << shift;
+        }
+        return out;
+    }
+
+    void fill_scalar(std::uint32_t* dst, std::size_t n, std::uint32_t colour) {
+        if ((colour >> 24) == 0xff) {
+            std::fill_n(dst, n, colour);
+        } else if (colour != 0) {
+            for (std::size_t i = 0; i < n; i++) {
+                dst[i] = over(colour, dst[i]);
+            }
+        }
+    }
+    void blend_scalar(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            dst[i] = over(src[i], dst[i]);
+        }
+    }
+    void mask_scalar(std::uint32_t* dst, const std::uint8_t* coverage, std::size_t n, std::uint32_t colour) {
+        for (std::size_t i = 0; i < n; i++) {
+            if (coverage[i] != 0) {
+                dst[i] = over(scale(colour, coverage[i]), dst[i]);
+            }
+        }
+    }
+
+#ifdef SI_SW_X86
+    // The same arithmetic as scale(), eight 16 bit channels at a time
+    __attribute__((target("sse2")))
+    inline __m128i div255_epu16(__m128i t) {
+        t = _mm_add_epi16(t, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    // Each pixel's alpha in all four of its bytes
+    __attribute__((target("sse2")))
+    inline __m128i splat_alpha(__m128i p) {
+        __m128i a = _mm_srli_epi32(p, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        return _mm_or_si128(a, _mm_slli_epi32(a, 16));
+    }
+    // p * f / 255, bytewise
+    __attribute__((target("sse2")))
+    inline __m128i scale_sse2(__m128i p, __m128i f) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(f, zero)));
+        const __m128i hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(f, zero)));
+        return _mm_packus_epi16(lo, hi);
+    }
+    __attribute__((target("sse2")))
+    inline __m128i over_sse2(__m128i s, __m128i d) {
+        const __m128i inverse = _mm_xor_si128(splat_alpha(s), _mm_set1_epi32(-1));
+        return _mm_add_epi8(s, scale_sse2(d, inverse));
+    }
+
+    __attribute__((target("sse2")))
+    void fill_sse2(std::uint32_t* dst, std::size_t n, std::uint32_t colour) {
+        if (colour == 0) {
+            return;
+        }
+        const __m128i s = _mm_set1_epi32(colour);
+        std::size_t i = 0;
+        if ((colour >> 24) == 0xff) {
+            for (; i + 4 <= n; i += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+            }
+        } else {
+            const __m128i inverse = _mm_set1_epi32(0x01010101 * (255 - (colour >> 24)));
+            for (; i + 4 <= n; i += 4) {
+                const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi8(s, scale_sse2(d, inverse)));
+            }
+        }
+        fill_scalar(dst + i, n - i, colour);
+    }
+    __attribute__((target("sse2")))
+    void blend_sse2(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), over_sse2(s, d));
+        }
+        blend_scalar(dst + i, src + i, n - i);
+    }
+    __attribute__((target("sse2")))
+    void mask_sse2(std::uint32_t* dst, const std::uint8_t* coverage, std::size_t n, std::uint32_t colour) {
+        const __m128i c = _mm_set1_epi32(colour);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            std::int32_t packed;
+            std::memcpy(&packed, coverage + i, 4);
+            if (packed == 0) {
+                continue;
+            }
+            // Each pixel's coverage in all four of its bytes
+            __m128i f = _mm_cvtsi32_si128(packed);
+            f = _mm_unpacklo_epi8(f, f);
+            f = _mm_unpacklo_epi16(f, f);
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), over_sse2(scale_sse2(c, f), d));
+        }
+        mask_scalar(dst + i, coverage + i, n - i, colour);
+    }
+
+    // As the SSE2 kernels, eight pixels at a time. Unpacking and packing both
+    // work within 128 bit lanes, so pixels come back out in the order they went in.
+    __attribute__((target("avx2")))
+    inline __m256i div255_epu16_avx2(__m256i t) {
+        t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+    __attribute__((target("avx2")))
+    inline __m256i scale_avx2(__m256i p, __m256i f) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i lo = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p, zero), _mm256_unpacklo_epi8(f, zero)));
+        const __m256i hi = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p, zero), _mm256_unpackhi_epi8(f, zero)));
+        return _mm256_packus_epi16(lo, hi);
+    }
+    __attribute__((target("avx2")))
+    inline __m256i over_avx2(__m256i s, __m256i d) {
+        const __m256i alpha = _mm256_shuffle_epi8(s, _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15, 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15));
+        return _mm256_add_epi8(s, scale_avx2(d, _mm256_xor_si256(alpha, _mm256_set1_epi32(-1))));
+    }
+
+    __attribute__((target("avx2")))
+    void fill_avx2(std::uint32_t* dst, std::size_t n, std::uint32_t colour) {
+        if (colour == 0) {
+            return;
+        }
+        const __m256i s = _mm256_set1_epi32(colour);
+        std::size_t i = 0;
+        if ((colour >> 24) == 0xff) {
+            for (; i + 8 <= n; i += 8) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+            }
+        } else {
+            const __m256i inverse = _mm256_set1_epi32(0x01010101 * (255 - (colour >> 24)));
+            for (; i + 8 <= n; i += 8) {
+                const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi8(s, scale_avx2(d, inverse)));
+            }
+        }
+        // Tails stay in this function: calling the SSE2 kernels from here
+        // would switch between VEX and legacy encodings, which stalls
+        for (; i < n; i++) {
+            dst[i] = over(colour, dst[i]);
+        }
+    }
+    __attribute__((target("avx2")))
+    void blend_avx2(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), over_avx2(s, d));
+        }
+        for (; i < n; i++) {
+            dst[i] = over(src[i], dst[i]);
+        }
+    }
+    __attribute__((target("avx2")))
+    void mask_avx2(std::uint32_t* dst, const std::uint8_t* coverage, std::size_t n, std::uint32_t colour) {
+        const __m256i c = _mm256_set1_epi32(colour);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            std::int64_t packed;
+            std::memcpy(&packed, coverage + i, 8);
+            if (packed == 0) {
+                continue;
+            }
+            const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coverage + i));
+            const __m256i f = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(bytes), _mm256_set1_epi32(0x01010101));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), over_avx2(scale_avx2(c, f), d));
+        }
+        for (; i < n; i++) {
+            dst[i] = over(scale(colour, coverage[i]), dst[i]);
+        }
+    }
+#else
+    // Never listed as supported, but defined so the tables exist everywhere
+    constexpr auto fill_sse2 = fill_scalar, fill_avx2 = fill_scalar;
+    constexpr auto blend_sse2 = blend_scalar, blend_avx2 = blend_scalar;
+    constexpr auto mask_sse2 = mask_scalar, mask_avx2 = mask_scalar;
+#endif
+
+    std::uint32_t lerp(std::uint32_t from, std::uint32_t to, std::uint32_t t) {
+        return scale(from, 255 - t) + scale(to, t);
+    }
+}
+
+const si::sw::span_kernels si::sw::span_kernels::scalar { "scalar", fill_scalar, blend_scalar, mask_scalar };
+const si::sw::span_kernels si::sw::span_kernels::sse2 { "sse2", fill_sse2, blend_sse2, mask_sse2 };
+const si::sw::span_kernels si::sw::span_kernels::avx2 { "avx2", fill_avx2, blend_avx2, mask_avx2 };
+
+std::vector<const si::sw::span_kernels*> si::sw::span_kernels::supported() {
+    std::vector<const span_kernels*> kernels { &scalar };
+#ifdef SI_SW_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back(&sse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&avx2);
+    }
+#endif
+    return kernels;
+}
+const si::sw::span_kernels* si::sw::span_kernels::find(std::string_view name) {
+    for (const span_kernels* k : supported()) {
+        if (name == k->name) {
+            return k;
+        }
+    }
+    return nullptr;
+}
+const si::sw::span_kernels& si::sw::span_kernels::best() {
+    static const span_kernels& chosen = []() -> const span_kernels& {
+        if (const char* name = std::getenv("SI_SW_KERNELS"); name && *name) {
+            if (const span_kernels* k = find(name)) {
+                return *k;
+            }
+            spdlog::warn("SI_SW_KERNELS={} isn't supported here, ignoring it", name);
+        }
+        return *supported().back();
+    }();
+    return chosen;
+}
+
+std::uint32_t si::sw::premultiply(std::uint32_t argb) {
+    const std::uint32_t alpha = argb >> 24;
+    return (alpha << 24) | (scale(argb, alpha) & 0x00ffffff);
+}
+si::sw::box si::sw::intersect(const box& a, const box& b) {
+    return box { std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1) };
+}
+si::sw::box si::sw::snap(float x, float y, float width, float height) {
+    // A pixel is covered if its centre is: [x, x + width) rounds to these
+    auto edge = [](float v) { return static_cast<std::int32_t>(std::ceil(v - 0.5f)); };
+    return box { edge(x), edge(y), edge(x + width), edge(y + height) };
+}
+
+si::sw::rasterizer::rasterizer(const span_kernels& kernels) : kernels(&kernels) {
+}
+const si::sw::span_kernels& si::sw::rasterizer::span() const {
+    return *kernels;
+}
+void si::sw::rasterizer::fill(const target& t, const box& clip, const box& b, std::uint32_t colour) {
+    const box area = intersect(intersect(clip, b), box { 0, 0, t.width, t.height });
+    if (area.empty()) {
+        return;
+    }
+    const std::uint32_t c = premultiply(colour);
+    for (std::int32_t y = area.y0; y < area.y1; y++) {
+        kernels->fill(t.pixels + std::ptrdiff_t{y} * t.stride + area.x0, area.x1 - area.x0, c);
+    }
+}
+void si::sw::rasterizer::fill_gradient(const target& t, const box& clip, const box& b, std::uint32_t from, std::uint32_t to, gradient_direction direction) {
+    const box area = intersect(intersect(clip, b), box { 0, 0, t.width, t.height });
+    if (area.empty()) {
+        return;
+    }
+    // Position along the gradient of a pixel's centre, 0-255
+    auto at = [](std::int32_t v, std::int32_t v0, std::int32_t v1) {
+        return v1 - v0 <= 1 ? 0u : static_cast<std::uint32_t>(std::lround((v - v0) * 255.0f / (v1 - v0 - 1)));
+    };
+    if (direction == gradient_direction::vertical) {
+        for (std::int32_t y = area.y0; y < area.y1; y++) {
+            const std::uint32_t c = premultiply(lerp(from, to, at(y, b.y0, b.y1)));
+            kernels->fill(t.pixels + std::ptrdiff_t{y} * t.stride + area.x0, area.x1 - area.x0, c);
+        }
+        return;
+    }
+    // Every row is the same, so it's worked out once
+    row.resize(area.x1 - area.x0);
+    for (std::int32_t x = area.x0; x < area.x1; x++) {
+        row[x - area.x0] = premultiply(lerp(from, to, at(x, b.x0, b.x1)));
+    }
+    for (std::int32_t y = area.y0; y < area.y1; y++) {
+        kernels->blend(t.pixels + std::ptrdiff_t{y} * t.stride + area.x0, row.data(), row.size());
+    }
+}
+void si::sw::rasterizer::fill_rounded(const target& t, const box& clip, const box& b, float radius, std::uint32_t colour) {
+    radius = std::min({radius, (b.x1 - b.x0) * 0.5f, (b.y1 - b.y0) * 0.5f});
+    const std::int32_t corner = static_cast<std::int32_t>(std::ceil(radius));
+    if (corner <= 0) {
+        return fill(t, clip, b, colour);
+    }
+    const box area = intersect(intersect(clip, b), box { 0, 0, t.width, t.height });
+    if (area.empty()) {
+        return;
+    }
+    const std::uint32_t c = premultiply(colour);
+    // Coverage of a pixel centre dx, dy from the inside corner's circle centre
+    auto covered = [&](float dx, float dy) {
+        const float d = radius - std::sqrt(dx * dx + dy * dy) + 0.5f;
+        return static_cast<std::uint8_t>(std::lround(std::clamp(d, 0.0f, 1.0f) * 255.0f));
+    };
+    coverage.resize(area.x1 - area.x0);
+    for (std::int32_t y = area.y0; y < area.y1; y++) {
+        std::uint32_t* dst = t.pixels + std::ptrdiff_t{y} * t.stride + area.x0;
+        // Distance of the pixel centre's row into the top or bottom corners, if it's in them
+        float dy = 0.0f;
+        if (y < b.y0 + corner) {
+            dy = b.y0 + radius - (y + 0.5f);
+        } else if (y >= b.y1 - corner) {
+            dy = (y + 0.5f) - (b.y1 - radius);
+        }
+        if (dy <= 0.0f) {
+            kernels->fill(dst, area.x1 - area.x0, c);
+            continue;
+        }
+        for (std::int32_t x = area.x0; x < area.x1; x++) {
+            float dx = 0.0f;
+            if (x < b.x0 + corner) {
+                dx = b.x0 + radius - (x + 0.5f);
+            } else if (x >= b.x1 - corner) {
+                dx = (x + 0.5f) - (b.x1 - radius);
+            }
+            coverage[x - area.x0] = covered(std::max(dx, 0.0f), dy);
+        }
+        kernels->mask(dst, coverage.data(), area.x1 - area.x0, c);
+    }
+}
+void si::sw::rasterizer::stroke(const target& t, const box& clip, const box& b, std::int32_t width, std::uint32_t colour) {
+    if (width <= 0) {
+        return;
+    }
+    const std::int32_t inner_y0 = std::min(b.y0 + width, b.y1);
+    const std::int32_t inner_y1 = std::max(b.y1 - width, inner_y0);
+    fill(t, clip, box { b.x0, b.y0, b.x1, inner_y0 }, colour);
+    fill(t, clip, box { b.x0, inner_y1, b.x1, b.y1 }, colour);
+    fill(t, clip, box { b.x0, inner_y0, std::min(b.x0 + width, b.x1), inner_y1 }, colour);
+    fill(t, clip, box { std::max(b.x1 - width, b.x0 + width), inner_y0, b.x1, inner_y1 }, colour);
+}
+void si::sw::rasterizer::blit(const target& t, const box& clip, const box& b, const image& img, float u0, float v0, float u1, float v1, std::uint32_t colour) {
+    const box area = intersect(intersect(clip, b), box { 0, 0, t.width, t.height });
+    if (area.empty() || img.width == 0 || img.height == 0) {
+        return;
+    }
+    const std::uint32_t tint = premultiply(colour);
+    // Texel under each pixel centre, stepping in 16.16 fixed point along the row
+    const float texels_per_x = (u1 - u0) * img.width / (b.x1 - b.x0);
+    const float texels_per_y = (v1 - v0) * img.height / (b.y1 - b.y0);
+    const std::int64_t step = std::llround(texels_per_x * 65536.0f);
+    const std::int64_t start = std::llround((u0 * img.width + (area.x0 - b.x0 + 0.5f) * texels_per_x) * 65536.0f);
+    row.resize(area.x1 - area.x0);
+    for (std::int32_t y = area.y0; y < area.y1; y++) {
+        const std::int32_t ty = std::clamp(static_cast<std::int32_t>(v0 * img.height + (y - b.y0 + 0.5f) * texels_per_y), 0, img.height - 1);
+        const std::uint32_t* texels = img.pixels.data() + std::ptrdiff_t{ty} * img.width;
+        std::int64_t u = start;
+        for (std::uint32_t& px : row) {
+            px = texels[std::clamp(static_cast<std::int32_t>(u >> 16), 0, img.width - 1)];
+            u += step;
+        }
+        if (tint != 0xffffffff) {
+            for (std::uint32_t& px : row) {
+                px = modulate(px, tint);
+            }
+        }
+        kernels->blend(t.pixels + std::ptrdiff_t{y} * t.stride + area.x0, row.data(), row.size());
+    }
+}
+void si::sw::rasterizer::mask(const target& t, const box& clip, std::int32_t x, std::int32_t y, const std::uint8_t* bitmap, std::int32_t width, std::int32_t height, std::int32_t pitch, std::uint32_t colour) {
+    const box area = intersect(intersect(clip, box { x, y, x + width, y + height }), box { 0, 0, t.width, t.height });
+    if (area.empty()) {
+        return;
+    }
+    const std::uint32_t c = premultiply(colour);
+    for (std::int32_t row_y = area.y0; row_y < area.y1; row_y++) {
+        const std::uint8_t* src = bitmap + std::ptrdiff_t{row_y - y} * pitch + (area.x0 - x);
+        kernels->mask(t.pixels + std::ptrdiff_t{row_y} * t.stride + area.x0, src, area.x1 - area.x0, c);
+    }
+}
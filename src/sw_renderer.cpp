@@ -0,0 +1,278 @@
+#include <si/sw_renderer.hpp>
+#include <FreeImage.h>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    std::uint64_t mix(std::uint64_t h, std::uint64_t v) {
+        return h ^ (v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
+    }
+    std::uint64_t hash(const si::sw::command& c) {
+        std::uint64_t h = static_cast<std::uint64_t>(c.what);
+        for (std::int32_t v : {c.bounds.x0, c.bounds.y0, c.bounds.x1, c.bounds.y1, c.stroke_width}) {
+            h = mix(h, static_cast<std::uint32_t>(v));
+        }
+        for (float v : {c.u0, c.v0, c.u1, c.v1}) {
+            h = mix(h, std::bit_cast<std::uint32_t>(v));
+        }
+        h = mix(h, c.colour);
+        h = mix(h, c.image);
+        return mix(h, reinterpret_cast<std::uintptr_t>(c.glyph));
+    }
+    // Premultiplied, in FreeImage's row order, which is the order the GPU path uploads in too
+    si::sw::image load_image(const std::string& filepath) {
+        FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filepath.c_str());
+        if (format == FIF_UNKNOWN) {
+            throw std::runtime_error(fmt::format("Couldn't determine the image format of {}", filepath));
+        }
+        std::unique_ptr<FIBITMAP, decltype(&FreeImage_Unload)> bitmap { FreeImage_Load(format, filepath.c_str()), FreeImage_Unload };
+        if (!bitmap) {
+            throw std::runtime_error(fmt::format("Couldn't load {}", filepath));
+        }
+        if (FreeImage_GetImageType(bitmap.get()) != FIT_BITMAP || FreeImage_GetBPP(bitmap.get()) != 32) {
+            bitmap.reset(FreeImage_ConvertTo32Bits(bitmap.get()));
+            if (!bitmap) {
+                throw std::runtime_error(fmt::format("Couldn't convert {} to 32 bits per pixel", filepath));
+            }
+        }
+        si::sw::image img;
+        img.width = FreeImage_GetWidth(bitmap.get());
+        img.height = FreeImage_GetHeight(bitmap.get());
+        img.pixels.resize(std::size_t(img.width) * img.height);
+        FreeImage_ConvertToRawBits(reinterpret_cast<BYTE*>(img.pixels.data()), bitmap.get(), img.width * 4, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+        std::transform(img.pixels.begin(), img.pixels.end(), img.pixels.begin(), si::sw::premultiply);
+        spdlog::info("Loaded {} ({}x{})", filepath, img.width, img.height);
+        return img;
+    }
+}
+
+si::sw::renderer::renderer(wl::shm& shm, std::int32_t width, std::int32_t height, std::size_t threads) : renderer(width, height, threads) {
+    swapchain.emplace(shm, width, height);
+}
+si::sw::renderer::renderer(std::int32_t width, std::int32_t height, std::size_t threads) :
+    width(width),
+    height(height),
+    workers(threads),
+    rasterizers(workers.size())
+    {
+    spdlog::info("Software rendering on {} threads with {} span kernels", workers.size(), span_kernels::best().name);
+}
+const si::sw::glyph_bitmap* si::sw::renderer::glyph(std::uint32_t face, std::uint32_t index, std::uint32_t size) {
+    const glyph_key key { face, index, size };
+    if (auto it = glyphs.find(key); it != glyphs.end()) {
+        return &it->second;
+    }
+    const std::optional<glyph_coverage> c = fonts.render(key);
+    if (!c) {
+        return nullptr;
+    }
+    // Glyphs with no coverage are cached empty, so they aren't rendered again
+    glyph_bitmap g {
+        .left = c->left,
+        .top = c->top,
+        .width = static_cast<std::int32_t>(c->width),
+        .height = static_cast<std::int32_t>(c->height),
+        .coverage = std::vector<std::uint8_t>(std::size_t{c->width} * c->height)
+    };
+    for (std::uint32_t row = 0; row < c->height; row++) {
+        std::copy_n(c->pixels + std::ptrdiff_t{c->pitch} * row, c->width, g.coverage.data() + std::size_t{row} * c->width);
+    }
+    return &glyphs.emplace(key, std::move(g)).first->second;
+}
+std::int32_t si::sw::renderer::tiles_x() const {
+    return (width + tile_size - 1) / tile_size;
+}
+std::int32_t si::sw::renderer::tiles_y() const {
+    return (height + tile_size - 1) / tile_size;
+}
+void si::sw::renderer::bin() {
+    const std::int32_t columns = tiles_x();
+    bins.resize(std::size_t(columns) * tiles_y());
+    for (auto& b : bins) {
+        b.clear();
+    }
+    std::vector<std::uint64_t> hashes(commands.size());
+    for (std::uint32_t i = 0; i < commands.size(); i++) {
+        const box b = intersect(commands[i].bounds, box { 0, 0, width, height });
+        if (b.empty()) {
+            continue;
+        }
+        hashes[i] = hash(commands[i]);
+        for (std::int32_t ty = b.y0 / tile_size; ty <= (b.y1 - 1) / tile_size; ty++) {
+            for (std::int32_t tx = b.x0 / tile_size; tx <= (b.x1 - 1) / tile_size; tx++) {
+                bins[ty * columns + tx].push_back(i);
+            }
+        }
+    }
+    // A tile's pixels are a function of its position, the background and its
+    // commands in order, so equal hashes mean there's nothing to redraw
+    tile_hashes.assign(bins.size(), 0);
+    for (std::size_t t = 0; t < bins.size(); t++) {
+        std::uint64_t h = mix(0x5157, background);
+        for (std::uint32_t i : bins[t]) {
+            h = mix(h, hashes[i]);
+        }
+        tile_hashes[t] = h;
+    }
+}
+void si::sw::renderer::draw_tile(std::uint32_t tile, const target& t, rasterizer& r) const {
+    const std::int32_t x = (tile % tiles_x()) * tile_size;
+    const std::int32_t y = (tile / tiles_x()) * tile_size;
+    const box clip { x, y, std::min(x + tile_size, t.width), std::min(y + tile_size, t.height) };
+    r.fill(t, clip, clip, background);
+    for (std::uint32_t i : bins[tile]) {
+        const command& c = commands[i];
+        switch (c.what) {
+        case command::kind::fill:
+            r.fill(t, clip, c.bounds, c.colour);
+            break;
+        case command::kind::stroke:
+            r.stroke(t, clip, c.bounds, c.stroke_width, c.colour);
+            break;
+        case command::kind::blit:
+            r.blit(t, clip, c.bounds, images[c.image], c.u0, c.v0, c.u1, c.v1, c.colour);
+            break;
+        case command::kind::mask:
+            r.mask(t, clip, c.bounds.x0, c.bounds.y0, c.glyph->coverage.data(), c.glyph->width, c.glyph->height, c.glyph->width, c.colour);
+            break;
+        }
+    }
+}
+bool si::sw::renderer::draw(wl::surface& surface) {
+    if (!swapchain || !needs_redraw()) {
+        return false;
+    }
+    bin();
+    if (presented.size() != tile_hashes.size()) {
+        full_damage = true;
+    }
+    std::vector<shm_damage> damage;
+    for (std::uint32_t i = 0; i < tile_hashes.size(); i++) {
+        if (full_damage || presented[i] != tile_hashes[i]) {
+            const std::int32_t x = (i % tiles_x()) * tile_size;
+            const std::int32_t y = (i / tiles_x()) * tile_size;
+            damage.push_back(shm_damage { x, y, std::min(tile_size, width - x), std::min(tile_size, height - y) });
+        }
+    }
+    scene_changed = false;
+    if (damage.empty()) {
+        return false;
+    }
+    shm_buffer* buffer = swapchain->acquire();
+    if (!buffer) {
+        scene_changed = true;
+        return false;
+    }
+    // Buffers hold older frames; a tile is redrawn if it differs from what this one holds
+    std::vector<std::uint64_t>& held = contents[buffer->id];
+    if (held.size() != tile_hashes.size()) {
+        held.assign(tile_hashes.size(), 0);
+    }
+    std::vector<std::uint32_t> dirty;
+    for (std::uint32_t i = 0; i < tile_hashes.size(); i++) {
+        if (held[i] != tile_hashes[i]) {
+            dirty.push_back(i);
+        }
+    }
+    // Items are handed out a tile at a time, so cheap tiles don't hold up busy ones
+    const target t { buffer->pixels, buffer->width, buffer->height, buffer->width };
+    workers.parallel_for(dirty.size(), [&](std::size_t item, std::size_t worker) {
+        draw_tile(dirty[item], t, rasterizers[worker]);
+    });
+    held = tile_hashes;
+    swapchain->present(surface, *buffer, full_damage ? std::vector<shm_damage>{} : damage);
+    presented = tile_hashes;
+    full_damage = false;
+    // Ids only grow, so the oldest buffers go first; the swapchain never keeps more than this
+    while (contents.size() > shm_swapchain::max_buffers * 2) {
+        contents.erase(contents.begin());
+    }
+    return true;
+}
+void si::sw::renderer::draw(const target& t) {
+    bin();
+    scene_changed = false;
+    workers.parallel_for(bins.size(), [&](std::size_t item, std::size_t worker) {
+        draw_tile(static_cast<std::uint32_t>(item), t, rasterizers[worker]);
+    });
+}
+bool si::sw::renderer::needs_redraw() const {
+    return full_damage || scene_changed;
+}
+void si::sw::renderer::resize(std::int32_t new_width, std::int32_t new_height) {
+    if (new_width == width && new_height == height) {
+        return;
+    }
+    width = new_width;
+    height = new_height;
+    if (swapchain) {
+        swapchain->resize(width, height);
+    }
+    contents.clear();
+    invalidate();
+}
+si::texture_region si::sw::renderer::load_texture(std::string filepath) {
+    images.push_back(load_image(filepath));
+    return si::texture_region { .texture = static_cast<std::uint32_t>(images.size() - 1) };
+}
+void si::sw::renderer::add_rect(const si::rect& r) {
+    const box b = snap(r.x, r.y, r.width, r.height);
+    // As in the GPU path, the border replaces the rect's colour rather than blending over it
+    const std::int32_t border = std::lround(r.border_width);
+    const box inner { b.x0 + border, b.y0 + border, b.x1 - border, b.y1 - border };
+    if (r.texture) {
+        const si::texture_region& region = *r.texture;
+        if (region.texture < images.size()) {
+            commands.push_back(command {
+                .what = command::kind::blit,
+                .bounds = b,
+                .colour = r.colour,
+                .image = region.texture,
+                .u0 = region.x,
+                .v0 = region.y,
+                .u1 = region.x + region.width,
+                .v1 = region.y + region.height
+            });
+            // Blits sample across the whole rect; the border covers its edge
+            if (border > 0) {
+                commands.push_back(command { .what = command::kind::stroke, .bounds = b, .colour = r.border_colour, .stroke_width = border });
+            }
+            scene_changed = true;
+            return;
+        }
+    }
+    if (!inner.empty()) {
+        commands.push_back(command { .what = command::kind::fill, .bounds = inner, .colour = r.colour });
+    }
+    if (border > 0) {
+        commands.push_back(command { .what = command::kind::stroke, .bounds = b, .colour = r.border_colour, .stroke_width = border });
+    }
+    scene_changed = true;
+}
+void si::sw::renderer::add_text(const si::text& t) {
+    const std::uint32_t face = fonts.face(t.font);
+    const std::uint32_t size = static_cast<std::uint32_t>(std::lround(t.size));
+    const shaped_run run = fonts.shape(t.content, face, size);
+    for (const shaped_glyph& sg : run.glyphs) {
+        if (const glyph_bitmap* g = glyph(face, sg.glyph, size); g && g->width > 0 && g->height > 0) {
+            const std::int32_t x = std::lround(t.x) + sg.x + g->left;
+            const std::int32_t y = std::lround(t.y) + run.ascender - g->top;
+            commands.push_back(command { .what = command::kind::mask, .bounds = { x, y, x + g->width, y + g->height }, .colour = t.colour, .glyph = g });
+        }
+    }
+    scene_changed = true;
+}
+void si::sw::renderer::clear() {
+    commands.clear();
+    scene_changed = true;
+}
+void si::sw::renderer::invalidate() {
+    for (auto& [id, held] : contents) {
+        std::fill(held.begin(), held.end(), 0);
+    }
+    full_damage = true;
+}
@@ -0,0 +1,255 @@
+#include <si/vk_allocator.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+struct si::vk::memory_block {
+    ::vk::UniqueDeviceMemory memory;
+    ::vk::DeviceSize size;
+    std::uint32_t top_order;
+    bool dedicated;
+    std::byte* mapped = nullptr;
+    std::vector<std::set<::vk::DeviceSize>> free_lists; // indexed by order - min_order
+    ::vk::DeviceSize used = 0;
+    std::size_t live = 0;
+};
+
+namespace {
+    using si::vk::memory_allocator;
+    using si::vk::memory_block;
+
+    std::uint32_t order_for(::vk::DeviceSize size) {
+        std::uint32_t order = memory_allocator::min_order;
+        while ((::vk::DeviceSize{1} << order) < size) {
+            order++;
+        }
+        return order;
+    }
+    // Takes a free range of exactly 2^order bytes from the block, splitting larger ranges as needed.
+    std::optional<::vk::DeviceSize> buddy_take(memory_block& block, std::uint32_t order) {
+        std::uint32_t from = order;
+        while (from <= block.top_order && block.free_lists[from - memory_allocator::min_order].empty()) {
+            from++;
+        }
+        if (from > block.top_order) {
+            return std::nullopt;
+        }
+        auto& list = block.free_lists[from - memory_allocator::min_order];
+        ::vk::DeviceSize offset = *list.begin();
+        list.erase(list.begin());
+        while (from > order) {
+            from--;
+            block.free_lists[from - memory_allocator::min_order].insert(offset + (::vk::DeviceSize{1} << from));
+        }
+        return offset;
+    }
+    void buddy_give(memory_block& block, ::vk::DeviceSize offset, std::uint32_t order) {
+        while (order < block.top_order) {
+            auto& list = block.free_lists[order - memory_allocator::min_order];
+            auto buddy = list.find(offset ^ (::vk::DeviceSize{1} << order));
+            if (buddy == list.end()) {
+                break;
+            }
+            list.erase(buddy);
+            offset &= ~(::vk::DeviceSize{1} << order);
+            order++;
+        }
+        block.free_lists[order - memory_allocator::min_order].insert(offset);
+    }
+}
+
+si::vk::allocation::allocation(memory_allocator* owner, memory_block* block, ::vk::DeviceSize offset, ::vk::DeviceSize size, std::uint32_t order):
+    owner(owner),
+    block(block),
+    order(order),
+    memory(*block->memory),
+    offset(offset),
+    size(size) {
+}
+si::vk::allocation::allocation(allocation&& other) noexcept:
+    owner(std::exchange(other.owner, nullptr)),
+    block(std::exchange(other.block, nullptr)),
+    order(other.order),
+    memory(std::exchange(other.memory, nullptr)),
+    offset(other.offset),
+    size(other.size) {
+}
+si::vk::allocation& si::vk::allocation::operator=(allocation&& other) noexcept {
+    if (this != &other) {
+        reset();
+        owner = std::exchange(other.owner, nullptr);
+        block = std::exchange(other.block, nullptr);
+        order = other.order;
+        memory = std::exchange(other.memory, nullptr);
+        offset = other.offset;
+        size = other.size;
+    }
+    return *this;
+}
+si::vk::allocation::~allocation() {
+    reset();
+}
+void si::vk::allocation::reset() {
+    if (owner) {
+        owner->free(*this);
+        owner = nullptr;
+        block = nullptr;
+        memory = nullptr;
+    }
+}
+si::vk::allocation::operator bool() const {
+    return owner != nullptr;
+}
+std::byte* si::vk::allocation::mapped() const {
+    if (!block || !block->mapped) {
+        throw std::runtime_error("Allocation is not host visible");
+    }
+    return block->mapped + offset;
+}
+
+si::vk::memory_allocator::memory_allocator(::vk::PhysicalDevice physical, ::vk::Device device):
+    device(device),
+    memory_properties(physical.getMemoryProperties()),
+    max_allocation_count(physical.getProperties().limits.maxMemoryAllocationCount),
+    pools(memory_properties.memoryTypeCount * 2),
+    created(std::chrono::steady_clock::now()) {
+}
+si::vk::memory_allocator::~memory_allocator() {
+    for (auto& pool : pools) {
+        for (auto& block : pool) {
+            if (block->live != 0) {
+                spdlog::warn("Destroying device memory block with {} live allocations", block->live);
+            }
+            if (block->mapped) {
+                device.unmapMemory(*block->memory);
+            }
+        }
+    }
+}
+si::vk::memory_block& si::vk::memory_allocator::add_block(std::size_t pool_ix, std::uint32_t memory_type, ::vk::DeviceSize size, bool dedicated) {
+    std::size_t device_allocations = 0;
+    for (const auto& pool : pools) {
+        device_allocations += pool.size();
+    }
+    if (device_allocations >= max_allocation_count) {
+        throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+    }
+    auto block = std::make_unique<memory_block>();
+    block->memory = device.allocateMemoryUnique (
+        ::vk::MemoryAllocateInfo {
+            .allocationSize = size,
+            .memoryTypeIndex = memory_type
+        },
+        nullptr
+    );
+    block->size = size;
+    block->top_order = dedicated ? 0 : order_for(size);
+    block->dedicated = dedicated;
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & ::vk::MemoryPropertyFlagBits::eHostVisible) {
+        block->mapped = static_cast<std::byte*>(device.mapMemory(*block->memory, 0, VK_WHOLE_SIZE));
+    }
+    if (!dedicated) {
+        block->free_lists.resize(block->top_order - min_order + 1);
+        block->free_lists.back().insert(0);
+    }
+    return *pools[pool_ix].emplace_back(std::move(block));
+}
+si::vk::allocation si::vk::memory_allocator::allocate(::vk::MemoryRequirements reqs, std::uint32_t memory_type, resource_kind kind) {
+    std::lock_guard lock(mutex);
+    const std::size_t pool_ix = memory_type * 2 + static_cast<std::size_t>(kind);
+    const ::vk::DeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type].heapIndex].size;
+    // Don't let a single block hog more than an eighth of a small heap.
+    std::uint32_t block_order = max_order;
+    while (block_order > min_order && (::vk::DeviceSize{1} << block_order) > heap_size / 8) {
+        block_order--;
+    }
+    total_allocations++;
+    requested_bytes += reqs.size;
+    // Buddy ranges are aligned to their own size, so rounding the size up to the alignment honours both.
+    const std::uint32_t order = order_for(std::max(reqs.size, reqs.alignment));
+    if (order >= block_order) {
+        memory_block& block = add_block(pool_ix, memory_type, reqs.size, true);
+        block.used = reqs.size;
+        block.live = 1;
+        return allocation(this, &block, 0, reqs.size, 0);
+    }
+    for (auto& block : pools[pool_ix]) {
+        if (block->dedicated) {
+            continue;
+        }
+        if (auto offset = buddy_take(*block, order)) {
+            block->used += ::vk::DeviceSize{1} << order;
+            block->live++;
+            return allocation(this, block.get(), *offset, reqs.size, order);
+        }
+    }
+    memory_block& block = add_block(pool_ix, memory_type, ::vk::DeviceSize{1} << block_order, false);
+    ::vk::DeviceSize offset = *buddy_take(block, order);
+    block.used += ::vk::DeviceSize{1} << order;
+    block.live++;
+    return allocation(this, &block, offset, reqs.size, order);
+}
+void si::vk::memory_allocator::free(allocation& alloc) {
+    std::lock_guard lock(mutex);
+    memory_block& block = *alloc.block;
+    requested_bytes -= alloc.size;
+    block.live--;
+    if (block.dedicated) {
+        block.used = 0;
+    } else {
+        block.used -= ::vk::DeviceSize{1} << alloc.order;
+        buddy_give(block, alloc.offset, alloc.order);
+    }
+    if (block.live != 0) {
+        return;
+    }
+    // Keep one empty block per pool around so alternating alloc/free doesn't hit the driver.
+    for (auto& pool : pools) {
+        auto it = std::find_if(pool.begin(), pool.end(), [&](const auto& b) { return b.get() == &block; });
+        if (it == pool.end()) {
+            continue;
+        }
+        const bool spare = !block.dedicated && std::none_of(pool.begin(), pool.end(), [&](const auto& b) {
+            return b.get() != &block && !b->dedicated && b->live == 0;
+        });
+        if (!spare) {
+            if (block.mapped) {
+                device.unmapMemory(*block.memory);
+            }
+            pool.erase(it);
+        }
+        return;
+    }
+}
+si::vk::allocator_stats si::vk::memory_allocator::stats() const {
+    std::lock_guard lock(mutex);
+    allocator_stats result;
+    ::vk::DeviceSize free_bytes = 0;
+    ::vk::DeviceSize largest_free = 0;
+    for (const auto& pool : pools) {
+        for (const auto& block : pool) {
+            result.device_allocations++;
+            result.live_allocations += block->live;
+            result.reserved_bytes += block->size;
+            result.used_bytes += block->used;
+            if (!block->dedicated) {
+                free_bytes += block->size - block->used;
+                for (std::uint32_t order = block->top_order; order >= min_order; order--) {
+                    if (!block->free_lists[order - min_order].empty()) {
+                        largest_free = std::max(largest_free, ::vk::DeviceSize{1} << order);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    result.total_allocations = total_allocations;
+    result.requested_bytes = requested_bytes;
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - created).count();
+    result.allocations_per_second = seconds > 0.0 ? total_allocations / seconds : 0.0;
+    result.internal_fragmentation = result.used_bytes ? 1.0 - double(requested_bytes) / result.used_bytes : 0.0;
+    result.external_fragmentation = free_bytes ? 1.0 - double(largest_free) / free_bytes : 0.0;
+    return result;
+}
@@ -0,0 +1,103 @@
+#include <si/vk_batch.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+::vk::VertexInputBindingDescription si::vk::rect_instance::binding_description = {
+    .binding = 0,
+    .stride = sizeof(rect_instance),
+    .inputRate = ::vk::VertexInputRate::eInstance
+};
+std::array<::vk::VertexInputAttributeDescription, 6> si::vk::rect_instance::input_descriptions = {
+    ::vk::VertexInputAttributeDescription {
+        .location = 0,
+        .binding = 0,
+        .format = ::vk::Format::eR32G32B32A32Sfloat,
+        .offset = offsetof(rect_instance, bounds)
+    },
+    ::vk::VertexInputAttributeDescription {
+        .location = 1,
+        .binding = 0,
+        .format = ::vk::Format::eR32G32B32A32Sfloat,
+        .offset = offsetof(rect_instance, uv)
+    },
+    // 0xAARRGGBB is stored little endian as B, G, R, A. Read as R8G8B8A8,
+    // which unlike B8G8R8A8 every device must support in vertex buffers,
+    // and swizzled back in the vertex shader.
+    ::vk::VertexInputAttributeDescription {
+        .location = 2,
+        .binding = 0,
+        .format = ::vk::Format::eR8G8B8A8Unorm,
+        .offset = offsetof(rect_instance, colour)
+    },
+    ::vk::VertexInputAttributeDescription {
+        .location = 3,
+        .binding = 0,
+        .format = ::vk::Format::eR8G8B8A8Unorm,
+        .offset = offsetof(rect_instance, border_colour)
+    },
+    ::vk::VertexInputAttributeDescription {
+        .location = 4,
+        .binding = 0,
+        .format = ::vk::Format::eR32Sfloat,
+        .offset = offsetof(rect_instance, border_width)
+    },
+    ::vk::VertexInputAttributeDescription {
+        .location = 5,
+        .binding = 0,
+        .format = ::vk::Format::eR32Uint,
+        .offset = offsetof(rect_instance, texture)
+    }
+};
+
+void si::vk::rect_batch::add(const si::rect& r) {
+    const si::texture_region region = r.texture.value_or(si::texture_region{});
+    instances.push_back (
+        rect_instance {
+            .bounds = {r.x, r.y, r.width, r.height},
+            .uv = {region.x, region.y, region.x + region.width, region.y + region.height},
+            .colour = r.colour,
+            .border_colour = r.border_colour,
+            .border_width = r.border_width,
+            .texture = r.texture ? region.texture : rect_instance::untextured
+        }
+    );
+}
+void si::vk::rect_batch::clear() {
+    instances.clear();
+}
+std::size_t si::vk::rect_batch::size() const {
+    return instances.size();
+}
+std::vector<si::vk::batch_draw> si::vk::rect_batch::write(rect_instance* dst) const {
+    if (instances.empty()) {
+        return {};
+    }
+    std::copy(instances.begin(), instances.end(), dst);
+    return { batch_draw { variant, 0, static_cast<std::uint32_t>(instances.size()) } };
+}
+void si::vk::rect_batch::collect_damage(std::vector<::vk::Rect2D>& damage) {
+    auto bounds = [](const rect_instance& r) {
+        const std::int32_t x0 = static_cast<std::int32_t>(std::floor(r.bounds.x));
+        const std::int32_t y0 = static_cast<std::int32_t>(std::floor(r.bounds.y));
+        const std::int32_t x1 = static_cast<std::int32_t>(std::ceil(r.bounds.x + r.bounds.z));
+        const std::int32_t y1 = static_cast<std::int32_t>(std::ceil(r.bounds.y + r.bounds.w));
+        return ::vk::Rect2D {{x0, y0}, {static_cast<std::uint32_t>(std::max(x1 - x0, 0)), static_cast<std::uint32_t>(std::max(y1 - y0, 0))}};
+    };
+    const std::size_t common = std::min(instances.size(), drawn.size());
+    for (std::size_t i = 0; i < common; i++) {
+        // rect_instance has no padding, so unchanged rects compare equal byte for byte
+        if (std::memcmp(&instances[i], &drawn[i], sizeof(rect_instance)) != 0) {
+            damage.push_back(bounds(drawn[i]));
+            damage.push_back(bounds(instances[i]));
+        }
+    }
+    for (std::size_t i = common; i < instances.size(); i++) {
+        damage.push_back(bounds(instances[i]));
+    }
+    for (std::size_t i = common; i < drawn.size(); i++) {
+        damage.push_back(bounds(drawn[i]));
+    }
+    drawn = instances;
+}
@@ -0,0 +1,81 @@
+#include <si/vk_pipeline_cache.hpp>
+#include <si/util.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Checks the VkPipelineCacheHeaderVersionOne at the front of the data against the device.
+    bool matches_device(const std::vector<std::byte>& data, const ::vk::PhysicalDeviceProperties& props) {
+        struct header {
+            std::uint32_t size;
+            std::uint32_t version;
+            std::uint32_t vendor_id;
+            std::uint32_t device_id;
+            std::uint8_t uuid[VK_UUID_SIZE];
+        } h;
+        if (data.size() < sizeof(h)) {
+            return false;
+        }
+        std::memcpy(&h, data.data(), sizeof(h));
+        return h.size >= sizeof(h)
+            && h.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && h.vendor_id == props.vendorID
+            && h.device_id == props.deviceID
+            && std::equal(std::begin(h.uuid), std::end(h.uuid), props.pipelineCacheUUID.begin());
+    }
+}
+
+si::vk::pipeline_cache::pipeline_cache(::vk::PhysicalDevice physical, ::vk::Device device): device(device) {
+    const ::vk::PhysicalDeviceProperties props = physical.getProperties();
+    std::vector<std::byte> data;
+    try {
+        path = si::cache_directory() / "pipelines" / fmt::format("{:04x}-{:04x}.bin", props.vendorID, props.deviceID);
+        if (std::filesystem::exists(path)) {
+            data = si::file_contents(path.string());
+        }
+    } catch (const std::exception& e) {
+        spdlog::warn("Can't read pipeline cache: {}", e.what());
+    }
+    if (!data.empty() && !matches_device(data, props)) {
+        spdlog::info("Discarding pipeline cache {} written by another driver or device", path.string());
+        data.clear();
+    }
+    loaded = !data.empty();
+    cache = device.createPipelineCacheUnique (
+        ::vk::PipelineCacheCreateInfo {
+            .flags = {},
+            .initialDataSize = data.size(),
+            .pInitialData = data.data()
+        }
+    );
+    spdlog::debug("Pipeline cache {} ({} bytes)", loaded ? "loaded" : "empty", data.size());
+}
+si::vk::pipeline_cache::~pipeline_cache() {
+    try {
+        save();
+    } catch (const std::exception& e) {
+        spdlog::warn("Can't save pipeline cache: {}", e.what());
+    }
+}
+::vk::PipelineCache si::vk::pipeline_cache::operator*() const {
+    return *cache;
+}
+std::size_t si::vk::pipeline_cache::data_size() const {
+    std::size_t size = 0;
+    if (::vk::Result r = device.getPipelineCacheData(*cache, &size, nullptr); r != ::vk::Result::eSuccess) {
+        throw std::runtime_error(fmt::format("Couldn't query pipeline cache size: {}", ::vk::to_string(r)));
+    }
+    return size;
+}
+void si::vk::pipeline_cache::save() const {
+    if (path.empty()) {
+        return;
+    }
+    std::vector<std::uint8_t> data = device.getPipelineCacheData(*cache);
+    std::filesystem::create_directories(path.parent_path());
+    std::vector<std::byte> bytes(data.size());
+    std::memcpy(bytes.data(), data.data(), data.size());
+    si::write_file_contents(path, bytes);
+}
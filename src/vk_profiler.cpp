@@ -0,0 +1,213 @@
+#include <si/vk_profiler.hpp>
+#include <si/vk_renderer.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+    constexpr std::uint32_t statistic_count = 5; // bits set in gpu_profiler::statistic_flags
+
+    std::string escaped(std::string_view s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                out += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+}
+
+si::vk::gpu_profiler::gpu_profiler(gfx_device& gfx, std::uint32_t frames_in_flight): device(*gfx.logical) {
+    const std::uint32_t valid_bits = gfx.physical.getQueueFamilyProperties()[gfx.graphics_q_family_ix].timestampValidBits;
+    if (valid_bits == 0) {
+        return;
+    }
+    valid_mask = valid_bits >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << valid_bits) - 1;
+    period_ns = gfx.physical.getProperties().limits.timestampPeriod;
+    slots.resize(frames_in_flight);
+    for (slot& s : slots) {
+        s.timestamps = device.createQueryPoolUnique (
+            ::vk::QueryPoolCreateInfo {
+                .queryType = ::vk::QueryType::eTimestamp,
+                .queryCount = max_scopes * 2
+            }
+        );
+        if (gfx.pipeline_statistics) {
+            s.statistics = device.createQueryPoolUnique (
+                ::vk::QueryPoolCreateInfo {
+                    .queryType = ::vk::QueryType::ePipelineStatistics,
+                    .queryCount = max_scopes,
+                    .pipelineStatistics = statistic_flags
+                }
+            );
+        }
+    }
+}
+bool si::vk::gpu_profiler::enabled() const {
+    return !slots.empty();
+}
+bool si::vk::gpu_profiler::has_statistics() const {
+    return enabled() && slots.front().statistics;
+}
+void si::vk::gpu_profiler::read_back(slot& s) {
+    if (s.scopes.empty()) {
+        return;
+    }
+    std::vector<std::uint64_t> ticks(s.scopes.size() * 2);
+    // No wait flag: a frame whose fence has signalled has its results, and
+    // anything else (a scope left open, say) is dropped rather than waited for
+    const ::vk::Result got_ticks = device.getQueryPoolResults (
+        *s.timestamps, 0, ticks.size(),
+        ticks.size() * sizeof(std::uint64_t), ticks.data(), sizeof(std::uint64_t),
+        ::vk::QueryResultFlagBits::e64
+    );
+    std::vector<std::uint64_t> counts(s.statistics_used * statistic_count);
+    const bool got_counts = s.statistics_used == 0 || device.getQueryPoolResults (
+        *s.statistics, 0, s.statistics_used,
+        counts.size() * sizeof(std::uint64_t), counts.data(), statistic_count * sizeof(std::uint64_t),
+        ::vk::QueryResultFlagBits::e64
+    ) == ::vk::Result::eSuccess;
+    if (got_ticks == ::vk::Result::eSuccess) {
+        for (std::uint64_t& t : ticks) {
+            t &= valid_mask;
+        }
+        const std::uint64_t frame_start = *std::min_element(ticks.begin(), ticks.end());
+        if (!epoch) {
+            epoch = frame_start;
+        }
+        auto ms = [&](std::uint64_t from, std::uint64_t to) {
+            return to >= from ? (to - from) * period_ns / 1e6 : 0.0;
+        };
+        gpu_frame_timing frame { .serial = s.serial, .start_ms = ms(*epoch, frame_start), .scopes = {} };
+        for (std::size_t i = 0; i < s.scopes.size(); i++) {
+            gpu_scope_timing timing {
+                .name = std::move(s.scopes[i].name),
+                .depth = s.scopes[i].depth,
+                .start_ms = ms(frame_start, ticks[i * 2]),
+                .duration_ms = ms(ticks[i * 2], ticks[i * 2 + 1]),
+                .statistics = std::nullopt
+            };
+            if (const auto q = s.scopes[i].statistics_query; q && got_counts) {
+                const std::uint64_t* c = counts.data() + *q * statistic_count;
+                timing.statistics = gpu_pipeline_statistics {
+                    .input_vertices = c[0],
+                    .input_primitives = c[1],
+                    .vertex_invocations = c[2],
+                    .clipped_primitives = c[3],
+                    .fragment_invocations = c[4]
+                };
+            }
+            frame.scopes.push_back(std::move(timing));
+        }
+        history.push_back(std::move(frame));
+        if (history.size() > max_history) {
+            history.pop_front();
+        }
+    }
+    s.scopes.clear();
+    s.statistics_used = 0;
+}
+void si::vk::gpu_profiler::begin_frame(::vk::CommandBuffer cmd, std::size_t frame_slot, std::uint64_t serial) {
+    if (!enabled()) {
+        return;
+    }
+    current = frame_slot;
+    depth = 0;
+    slot& s = slots[current];
+    read_back(s);
+    s.serial = serial;
+    cmd.resetQueryPool(*s.timestamps, 0, max_scopes * 2);
+    if (s.statistics) {
+        cmd.resetQueryPool(*s.statistics, 0, max_scopes);
+    }
+}
+std::uint32_t si::vk::gpu_profiler::begin(::vk::CommandBuffer cmd, std::string_view name, bool statistics) {
+    if (!enabled() || slots[current].scopes.size() == max_scopes) {
+        return no_scope;
+    }
+    slot& s = slots[current];
+    const std::uint32_t scope = s.scopes.size();
+    cmd.writeTimestamp(::vk::PipelineStageFlagBits::eTopOfPipe, *s.timestamps, scope * 2);
+    std::optional<std::uint32_t> query;
+    if (statistics && s.statistics) {
+        query = s.statistics_used++;
+        cmd.beginQuery(*s.statistics, *query, {});
+    }
+    s.scopes.push_back(open_scope { .name = std::string(name), .depth = depth++, .statistics_query = query });
+    return scope;
+}
+void si::vk::gpu_profiler::end(::vk::CommandBuffer cmd, std::uint32_t scope) {
+    if (scope == no_scope) {
+        return;
+    }
+    slot& s = slots[current];
+    cmd.writeTimestamp(::vk::PipelineStageFlagBits::eBottomOfPipe, *s.timestamps, scope * 2 + 1);
+    if (const auto query = s.scopes[scope].statistics_query) {
+        cmd.endQuery(*s.statistics, *query);
+    }
+    depth--;
+}
+const std::deque<si::vk::gpu_frame_timing>& si::vk::gpu_profiler::frames() const {
+    return history;
+}
+std::string si::vk::gpu_profiler::json() const {
+    std::string out = "[";
+    for (const gpu_frame_timing& frame : history) {
+        if (&frame != &history.front()) {
+            out += ',';
+        }
+        fmt::format_to(std::back_inserter(out), "{{\"serial\":{},\"start_ms\":{:.4f},\"scopes\":[", frame.serial, frame.start_ms);
+        for (const gpu_scope_timing& scope : frame.scopes) {
+            if (&scope != &frame.scopes.front()) {
+                out += ',';
+            }
+            fmt::format_to (
+                std::back_inserter(out), "{{\"name\":\"{}\",\"depth\":{},\"start_ms\":{:.4f},\"duration_ms\":{:.4f}",
+                escaped(scope.name), scope.depth, scope.start_ms, scope.duration_ms
+            );
+            if (const auto& st = scope.statistics) {
+                fmt::format_to (
+                    std::back_inserter(out),
+                    ",\"statistics\":{{\"input_vertices\":{},\"input_primitives\":{},\"vertex_invocations\":{},\"clipped_primitives\":{},\"fragment_invocations\":{}}}",
+                    st->input_vertices, st->input_primitives, st->vertex_invocations, st->clipped_primitives, st->fragment_invocations
+                );
+            }
+            out += '}';
+        }
+        out += "]}";
+    }
+    out += ']';
+    return out;
+}
+std::string si::vk::gpu_profiler::chrome_trace() const {
+    // Complete ("X") events in microseconds, which chrome://tracing and Perfetto nest by time
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    for (const gpu_frame_timing& frame : history) {
+        for (const gpu_scope_timing& scope : frame.scopes) {
+            if (!first) {
+                out += ',';
+            }
+            first = false;
+            fmt::format_to (
+                std::back_inserter(out), "{{\"name\":\"{}\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"frame\":{}",
+                escaped(scope.name), (frame.start_ms + scope.start_ms) * 1000.0, scope.duration_ms * 1000.0, frame.serial
+            );
+            if (const auto& st = scope.statistics) {
+                fmt::format_to (
+                    std::back_inserter(out), ",\"input_vertices\":{},\"vertex_invocations\":{},\"clipped_primitives\":{},\"fragment_invocations\":{}",
+                    st->input_vertices, st->vertex_invocations, st->clipped_primitives, st->fragment_invocations
+                );
+            }
+            out += "}}";
+        }
+    }
+    out += "],\"displayTimeUnit\":\"ms\"}";
+    return out;
+}
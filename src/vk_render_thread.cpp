@@ -0,0 +1,134 @@
+#include <si/vk_render_thread.hpp>
+#include <utility>
+
+bool si::vk::frame_snapshot::empty() const {
+    return !extent && !scene && !invalidate && !configure;
+}
+void si::vk::frame_snapshot::merge(frame_snapshot&& later) {
+    if (later.extent) {
+        extent = later.extent;
+    }
+    if (later.scene) {
+        scene = std::move(later.scene);
+    }
+    invalidate = invalidate || later.invalidate;
+    // Acking the latest configure acks those before it too
+    if (later.configure) {
+        configure = std::move(later.configure);
+    }
+}
+
+si::vk::render_thread::render_thread(std::unique_ptr<renderer> renderer, std::function<void()> notify):
+    r(std::move(renderer)),
+    notify(std::move(notify)) {
+    // Decoded images are uploaded by the next draw, so it's this thread that wants waking
+    r->wake_on_decode([this]() { loop.wake(); });
+    loop.before_wait.connect([this]() { render(); });
+    thread = std::thread([this]() {
+        try {
+            loop.run();
+        } catch (...) {
+            error = std::current_exception();
+            failed.store(true);
+            if (this->notify) {
+                this->notify();
+            }
+        }
+    });
+}
+si::vk::render_thread::~render_thread() {
+    loop.post([this]() { loop.stop(); });
+    thread.join();
+    // Decoders still running are only joined when the renderer goes, which
+    // would otherwise be after the loop they wake has been destroyed
+    r->wake_on_decode({});
+    r.reset();
+}
+void si::vk::render_thread::submit(frame_snapshot snapshot) {
+    // Merged rather than queued behind what's held, so snapshots stay in order
+    held.merge(std::move(snapshot));
+    flush();
+}
+void si::vk::render_thread::flush() {
+    if (failed.load()) {
+        std::rethrow_exception(error);
+    }
+    if (held.empty()) {
+        return;
+    }
+    // Raised before trying, not after failing: otherwise the render thread
+    // could empty the queue in between and never see it, leaving this
+    // snapshot held until something else wakes the UI thread.
+    backlogged.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (snapshots.push(std::move(held))) {
+        held = frame_snapshot {};
+        backlogged.store(false);
+        loop.wake();
+    }
+}
+std::uint64_t si::vk::render_thread::frames() const {
+    return drawn.load();
+}
+void si::vk::render_thread::apply(frame_snapshot&& snapshot) {
+    if (snapshot.extent) {
+        r->resize(snapshot.extent->width, snapshot.extent->height);
+    }
+    if (snapshot.scene) {
+        r->clear();
+        for (const si::rect& rect : snapshot.scene->rects) {
+            r->add_rect(rect);
+        }
+        for (const si::text& t : snapshot.scene->texts) {
+            r->add_text(t);
+        }
+    }
+    // The ack only takes effect with a commit, so there has to be a frame to carry it
+    if (snapshot.invalidate || snapshot.configure) {
+        r->invalidate();
+    }
+    if (snapshot.configure) {
+        configure = std::move(snapshot.configure);
+    }
+}
+void si::vk::render_thread::render() {
+    bool changed = false;
+    while (std::optional<frame_snapshot> snapshot = snapshots.pop()) {
+        apply(std::move(*snapshot));
+        changed = true;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (backlogged.exchange(false) && notify) {
+        notify();
+    }
+    if (throttle_timer >= 0) {
+        return;
+    }
+    // Uploads finish on fences, which have no fd to wait on, so textures
+    // still streaming in are polled for unless there's something new to draw
+    if (upload_poll >= 0) {
+        if (!changed) {
+            return;
+        }
+        loop.cancel_timer(upload_poll);
+        upload_poll = -1;
+    }
+    if (!r->needs_redraw()) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (const auto due = last_drawn + r->min_frame_interval; now < due) {
+        throttle_timer = loop.add_timer(due - now, {}, [this]() { throttle_timer = -1; });
+        return;
+    }
+    if (configure) {
+        std::exchange(configure, {})();
+    }
+    // May wait for a frame in flight or a swapchain image; only this thread stalls
+    if (r->draw()) {
+        last_drawn = now;
+        drawn++;
+    } else if (r->needs_redraw()) {
+        upload_poll = loop.add_timer(std::chrono::milliseconds(8), {}, [this]() { upload_poll = -1; });
+    }
+}
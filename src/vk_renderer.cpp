@@ -6,21 +6,70 @@
 #include <limits>
 #include <chrono>
 #include <array>
+#include <algorithm>
+#include <string_view>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <si/util.hpp>
+#include <cstdlib>
+#include <cstring>
+#include "vert.spv.hpp"
+#include "frag.spv.hpp"
+#include "rect.vert.spv.hpp"
+#include "rect.frag.spv.hpp"
 
 namespace {
-    const std::vector<const char*> exts_required = { "VK_KHR_swapchain" };
+    // Descriptor indexing (with maintenance3, which it needs) lets texture_manager keep every texture in one array
+    const std::vector<const char*> exts_required = { "VK_KHR_swapchain", "VK_KHR_maintenance3", "VK_EXT_descriptor_indexing" };
     const auto win_image_format = ::vk::Format::eB8G8R8A8Srgb;
     const auto win_color_space = ::vk::ColorSpaceKHR::eSrgbNonlinear;
 
-    ::vk::UniqueShaderModule make_module(::vk::Device device, std::string filename) {
-        auto code = si::file_contents(filename);
-        if (code.size() % 4 != 0) {
-            throw std::runtime_error("Code size must be multiple of 4.");
+    struct presentation {
+        ::vk::PresentModeKHR mode;
+        std::uint32_t image_count;
+    };
+    presentation negotiate_presentation(si::present_policy policy, const std::vector<::vk::PresentModeKHR>& modes, const ::vk::SurfaceCapabilitiesKHR& caps) {
+        auto supported = [&](::vk::PresentModeKHR mode) {
+            return std::find(modes.begin(), modes.end(), mode) != modes.end();
+        };
+        auto clamp_images = [&](std::uint32_t count) {
+            // maxImageCount of 0 means there's no limit
+            return caps.maxImageCount == 0 ? std::max(count, caps.minImageCount) : std::clamp(count, caps.minImageCount, caps.maxImageCount);
+        };
+        // FIFO is the only mode every implementation has to support
+        switch (policy) {
+        case si::present_policy::low_latency:
+            if (supported(::vk::PresentModeKHR::eMailbox)) {
+                // Mailbox needs a spare image to replace the queued one without blocking
+                return {::vk::PresentModeKHR::eMailbox, clamp_images(caps.minImageCount + 1)};
+            } else if (supported(::vk::PresentModeKHR::eImmediate)) {
+                return {::vk::PresentModeKHR::eImmediate, clamp_images(caps.minImageCount)};
+            }
+            return {::vk::PresentModeKHR::eFifo, clamp_images(caps.minImageCount)};
+        case si::present_policy::smooth:
+            return {::vk::PresentModeKHR::eFifo, clamp_images(3)};
+        case si::present_policy::power_saver:
+            return {::vk::PresentModeKHR::eFifo, clamp_images(caps.minImageCount)};
+        }
+        throw std::runtime_error("Unknown present policy");
+    }
+
+    // Frames of damage kept for bringing older swapchain images up to date
+    constexpr std::size_t max_damage_history = 8;
+    std::optional<::vk::Rect2D> clip(::vk::Rect2D r, ::vk::Extent2D extent) {
+        const std::int32_t x0 = std::max(r.offset.x, 0);
+        const std::int32_t y0 = std::max(r.offset.y, 0);
+        const std::int32_t x1 = std::min<std::int64_t>(std::int64_t{r.offset.x} + r.extent.width, extent.width);
+        const std::int32_t y1 = std::min<std::int64_t>(std::int64_t{r.offset.y} + r.extent.height, extent.height);
+        if (x1 <= x0 || y1 <= y0) {
+            return std::nullopt;
         }
-        return device.createShaderModuleUnique( {{}, code.size(), reinterpret_cast<std::uint32_t*>(code.data())} );
+        return ::vk::Rect2D {{x0, y0}, {static_cast<std::uint32_t>(x1 - x0), static_cast<std::uint32_t>(y1 - y0)}};
+    }
+
+    template<std::size_t N>
+    ::vk::UniqueShaderModule make_module(::vk::Device device, const std::uint32_t (&code)[N]) {
+        return device.createShaderModuleUnique( {{}, sizeof(code), code} );
     }
 }
 
@@ -60,34 +109,137 @@ void si::vk::renderer::reset_descriptor_set_layout() {
 }
 
 void si::vk::renderer::reset_pipeline() {
+    const ::vk::PushConstantRange push_constant_range {
+        .stageFlags = ::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment,
+        .offset = 0,
+        .size = sizeof(push_constants)
+    };
+    const std::array set_layouts { *descriptor_set_layout, textures.set_layout() };
     pipeline_layout = device.logical->createPipelineLayoutUnique (
         ::vk::PipelineLayoutCreateInfo {
             .flags = {},
-            .setLayoutCount = 1,
-            .pSetLayouts = std::to_address(descriptor_set_layout),
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = nullptr
+            .setLayoutCount = static_cast<std::uint32_t>(set_layouts.size()),
+            .pSetLayouts = set_layouts.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &push_constant_range
         }
     );
-    std::vector<::vk::PipelineShaderStageCreateInfo> stages;
-    std::vector<::vk::UniqueShaderModule> shaders;
-    for (auto [stage_name, stage] : std::vector {std::make_pair("vert", ::vk::ShaderStageFlagBits::eVertex),
-                                                 std::make_pair("frag", ::vk::ShaderStageFlagBits::eFragment)}) {
-        shaders.push_back(make_module(*device.logical, fmt::format("build/{}.spv", stage_name)));
-        stages.emplace_back (
-            ::vk::PipelineShaderStageCreateFlags(),
-            stage,
-            *shaders.back(),
-            "main"
-        );
-    }
-    const ::vk::PipelineVertexInputStateCreateInfo input_state {
+    vert_module = make_module(*device.logical, spirv::vert);
+    frag_module = make_module(*device.logical, spirv::frag);
+    rect_vert_module = make_module(*device.logical, spirv::rect_vert);
+    rect_frag_module = make_module(*device.logical, spirv::rect_frag);
+    const ::vk::AttachmentDescription colour_attachment {
         .flags = {},
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &vk::vertex::binding_description,
-        .vertexAttributeDescriptionCount = vk::vertex::input_descriptions.size(),
-        .pVertexAttributeDescriptions = vk::vertex::input_descriptions.data()
+        .format = ::vk::Format::eB8G8R8A8Srgb,
+        .samples = ::vk::SampleCountFlagBits::e1,
+        .loadOp = ::vk::AttachmentLoadOp::eClear,
+        .storeOp = ::vk::AttachmentStoreOp::eStore,
+        .stencilLoadOP = ::vk::AttachmentLoadOp::eDontCare,
+        .stencilStoreOP = ::vk::AttachmentStoreOp::eDontCare,
+        .initialLayout = ::vk::ImageLayout::eUndefined,
+        .finalLayout = target_layout
+    };
+    const ::vk::AttachmentReference colour_attachment_ref {
+        .attachment = 0,
+        .layout = ::vk::ImageLayout::eColorAttachmentOptimal
+    };
+    const ::vk::SubpassDescription subpass {
+        .flags = ::vk::SubpassDescriptionFlags{},
+        .pipelineBindPoint = ::vk::PipelineBindPoint::eGraphics,
+        .inputAttachmentCount = 0,
+        .pInputAttachments = nullptr,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colour_attachment_ref,
+        .pResolveAttachments = nullptr,
+        .pDepthStencilAttachment = nullptr,
+        .preserveAttachmentCount = 0,
+        .pPreserveAttachments = nullptr
+    };
+    const ::vk::SubpassDependency subpass_dependency {
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        .dstSubpass = 0,
+        .srcStageMask = ::vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        .dstStageMask = ::vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        .srcAccessMask = {},
+        .dstAccessMask = ::vk::AccessFlagBits::eColorAttachmentRead | ::vk::AccessFlagBits::eColorAttachmentWrite
+    };
+    render_pass = device.logical->createRenderPassUnique (
+        ::vk::RenderPassCreateInfo {
+            .flags = {},
+            .attachmentCount = 1,
+            .pAttachments = &colour_attachment,
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = 1,
+            .pDependencies = &subpass_dependency
+        }
+    );
+    // Differs only in load op and initial layout, so framebuffers and pipelines work with either
+    ::vk::AttachmentDescription kept_attachment = colour_attachment;
+    kept_attachment.loadOp = ::vk::AttachmentLoadOp::eLoad;
+    kept_attachment.initialLayout = target_layout;
+    render_pass_load = device.logical->createRenderPassUnique (
+        ::vk::RenderPassCreateInfo {
+            .flags = {},
+            .attachmentCount = 1,
+            .pAttachments = &kept_attachment,
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = 1,
+            .pDependencies = &subpass_dependency
+        }
+    );
+    pipeline_variants.clear();
+    // Build the common variants up front so the first frame doesn't pay for them
+    get_pipeline(pipeline_variant{});
+    get_pipeline(rect_batch::variant);
+}
+::vk::Pipeline si::vk::renderer::get_pipeline(pipeline_variant variant) {
+    if (auto it = pipeline_variants.find(variant); it != pipeline_variants.end()) {
+        return *it->second;
+    }
+    const std::array<::vk::Bool32, 2> constants { variant.textured, variant.coloured };
+    const std::array<::vk::SpecializationMapEntry, 2> constant_entries {
+        ::vk::SpecializationMapEntry { .constantID = 0, .offset = 0, .size = sizeof(::vk::Bool32) },
+        ::vk::SpecializationMapEntry { .constantID = 1, .offset = sizeof(::vk::Bool32), .size = sizeof(::vk::Bool32) }
+    };
+    const ::vk::SpecializationInfo frag_specialization {
+        .mapEntryCount = static_cast<std::uint32_t>(constant_entries.size()),
+        .pMapEntries = constant_entries.data(),
+        .dataSize = sizeof(constants),
+        .pData = constants.data()
     };
+    const std::array stages {
+        ::vk::PipelineShaderStageCreateInfo {
+            .flags = {},
+            .stage = ::vk::ShaderStageFlagBits::eVertex,
+            .module = variant.instanced ? *rect_vert_module : *vert_module,
+            .pName = "main",
+            .pSpecializationInfo = nullptr
+        },
+        ::vk::PipelineShaderStageCreateInfo {
+            .flags = {},
+            .stage = ::vk::ShaderStageFlagBits::eFragment,
+            .module = variant.instanced ? *rect_frag_module : *frag_module,
+            .pName = "main",
+            .pSpecializationInfo = &frag_specialization
+        }
+    };
+    const ::vk::PipelineVertexInputStateCreateInfo input_state = variant.instanced
+        ? ::vk::PipelineVertexInputStateCreateInfo {
+            .flags = {},
+            .vertexBindingDescriptionCount = 1,
+            .pVertexBindingDescriptions = &vk::rect_instance::binding_description,
+            .vertexAttributeDescriptionCount = vk::rect_instance::input_descriptions.size(),
+            .pVertexAttributeDescriptions = vk::rect_instance::input_descriptions.data()
+        }
+        : ::vk::PipelineVertexInputStateCreateInfo {
+            .flags = {},
+            .vertexBindingDescriptionCount = 1,
+            .pVertexBindingDescriptions = &vk::vertex::binding_description,
+            .vertexAttributeDescriptionCount = vk::vertex::input_descriptions.size(),
+            .pVertexAttributeDescriptions = vk::vertex::input_descriptions.data()
+        };
     const ::vk::PipelineInputAssemblyStateCreateInfo assembly_state {
         .flags = {},
         .topology = ::vk::PrimitiveTopology::eTriangleList,
@@ -105,7 +257,8 @@ void si::vk::renderer::reset_pipeline() {
         .depthClampEnable = false,
         .rasterizerDiscardEnable = false,
         .polygonMode = ::vk::PolygonMode::eFill,
-        .cullMode = ::vk::CullModeFlagBits::eBack,
+        // Rects are laid out in pixels with y down, which flips their winding
+        .cullMode = variant.instanced ? ::vk::CullModeFlagBits::eNone : ::vk::CullModeFlagBits::eBack,
         .frontFace = ::vk::FrontFace::eCounterClockwise,
         .depthBiasEnable = false,
         .depthBiasClamp = 0.0f,
@@ -121,13 +274,14 @@ void si::vk::renderer::reset_pipeline() {
         .alphaToCoverageEnable = false,
         .alphaToOneEnable = false
     };
+    // Rects are drawn over what's already there, so they blend
     const ::vk::PipelineColorBlendAttachmentState color_blend_attachment_state {
-        .blendEnable = false,
-        .srcColorBlendFactor = ::vk::BlendFactor::eOne,
-        .dstColorBlendFactor = ::vk::BlendFactor::eZero,
+        .blendEnable = variant.instanced,
+        .srcColorBlendFactor = variant.instanced ? ::vk::BlendFactor::eSrcAlpha : ::vk::BlendFactor::eOne,
+        .dstColorBlendFactor = variant.instanced ? ::vk::BlendFactor::eOneMinusSrcAlpha : ::vk::BlendFactor::eZero,
         .colorBlendOp = ::vk::BlendOp::eAdd,
-        .srcAlphaBlendFactor = ::vk::BlendFactor::eZero,
-        .dstAlphaBlendFactor = ::vk::BlendFactor::eZero,
+        .srcAlphaBlendFactor = variant.instanced ? ::vk::BlendFactor::eOne : ::vk::BlendFactor::eZero,
+        .dstAlphaBlendFactor = variant.instanced ? ::vk::BlendFactor::eOneMinusSrcAlpha : ::vk::BlendFactor::eZero,
         .alphaBlendOp = ::vk::BlendOp::eAdd,
         .colorWriteMask = ::vk::ColorComponentFlagBits::eR
                         | ::vk::ColorComponentFlagBits::eG
@@ -142,60 +296,16 @@ void si::vk::renderer::reset_pipeline() {
         .pAttachments = &color_blend_attachment_state,
         .blendConstants = {0.0f, 0.0f, 0.0f, 0.0f}
     };
-    const ::vk::AttachmentDescription colour_attachment {
-        .flags = {},
-        .format = ::vk::Format::eB8G8R8A8Srgb,
-        .samples = ::vk::SampleCountFlagBits::e1,
-        .loadOp = ::vk::AttachmentLoadOp::eClear,
-        .storeOp = ::vk::AttachmentStoreOp::eStore,
-        .stencilLoadOP = ::vk::AttachmentLoadOp::eDontCare,
-        .stencilStoreOP = ::vk::AttachmentStoreOp::eDontCare,
-        .initialLayout = ::vk::ImageLayout::eUndefined,
-        .finalLayout = ::vk::ImageLayout::ePresentSrcKHR
-    };
-    const ::vk::AttachmentReference colour_attachment_ref {
-        .attachment = 0,
-        .layout = ::vk::ImageLayout::eColorAttachmentOptimal
-    };
-    const ::vk::SubpassDescription subpass {
-        .flags = ::vk::SubpassDescriptionFlags{},
-        .pipelineBindPoint = ::vk::PipelineBindPoint::eGraphics,
-        .inputAttachmentCount = 0,
-        .pInputAttachments = nullptr,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colour_attachment_ref,
-        .pResolveAttachments = nullptr,
-        .pDepthStencilAttachment = nullptr,
-        .preserveAttachmentCount = 0,
-        .pPreserveAttachments = nullptr
-    };
-    const ::vk::SubpassDependency subpass_dependency {
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = ::vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        .dstStageMask = ::vk::PipelineStageFlagBits::eColorAttachmentOutput,
-        .srcAccessMask = {},
-        .dstAccessMask = ::vk::AccessFlagBits::eColorAttachmentRead | ::vk::AccessFlagBits::eColorAttachmentWrite
-    };
-    render_pass = device.logical->createRenderPassUnique (
-        ::vk::RenderPassCreateInfo {
-            .flags = {},
-            .attachmentCount = 1,
-            .pAttachments = &colour_attachment,
-            .subpassCount = 1,
-            .pSubpasses = &subpass,
-            .dependencyCount = 1,
-            .pDependencies = &subpass_dependency
-        }
-    );
     const std::array dynamic_states = {::vk::DynamicState::eViewport, ::vk::DynamicState::eScissor};
     const ::vk::PipelineDynamicStateCreateInfo dynamic_state {
         .flags = {},
         .dynamicStateCount = dynamic_states.size(),
         .pDynamicStates = dynamic_states.data()
     };
-    pipeline = device.logical->createGraphicsPipelineUnique (
-        nullptr,
+    const auto started = std::chrono::steady_clock::now();
+    const std::size_t cache_size = device.pipelines->data_size();
+    ::vk::UniquePipeline pipeline = device.logical->createGraphicsPipelineUnique (
+        *device.pipelines,
         ::vk::GraphicsPipelineCreateInfo {
             .flags = {},
             .stageCount = static_cast<std::uint32_t>(stages.size()),
@@ -216,8 +326,36 @@ void si::vk::renderer::reset_pipeline() {
             .basePipelineIndex = -1
         }
     );
+    // A pipeline that was already cached doesn't add anything to the cache
+    const bool hit = device.pipelines->loaded && device.pipelines->data_size() == cache_size;
+    spdlog::info (
+        "Created graphics pipeline (textured: {}, coloured: {}, instanced: {}) in {:.2f} ms (pipeline cache {})",
+        variant.textured, variant.coloured, variant.instanced,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count(),
+        hit ? "hit" : "miss"
+    );
+    return *pipeline_variants.emplace(variant, std::move(pipeline)).first->second;
 }
 void si::vk::renderer::reset_swapchain(std::uint32_t width, std::uint32_t height) {
+    if (headless()) {
+        swapchain_extent = ::vk::Extent2D {std::max(width, 1u), std::max(height, 1u)};
+        if (!offscreen_images.empty()) {
+            retired_swapchains.push_back (
+                retired_swapchain {
+                    .swapchain = {},
+                    .offscreen_images = std::move(offscreen_images),
+                    .offscreen_memory = std::move(offscreen_memory),
+                    .image_views = std::move(swapchain_image_views),
+                    .framebuffers = std::move(framebuffers),
+                    .last_serial = frame_serial
+                }
+            );
+            swapchain_image_views.clear();
+            framebuffers.clear();
+        }
+        reset_offscreen_images();
+        return;
+    }
     ::vk::SurfaceCapabilitiesKHR caps = device.physical.getSurfaceCapabilitiesKHR(*surface);
 
     std::vector<::vk::SurfaceFormatKHR> formats = device.physical.getSurfaceFormatsKHR(*surface);
@@ -227,13 +365,24 @@ void si::vk::renderer::reset_swapchain(std::uint32_t width, std::uint32_t height
     std::vector<::vk::PresentModeKHR> modes = device.physical.getSurfacePresentModesKHR(*surface);
     spdlog::info("Available modes:");
     for (auto mode : modes) { spdlog::info(" * {}", to_string(mode)); }
+    const presentation negotiated = negotiate_presentation(policy, modes, caps);
+    present_mode = negotiated.mode;
+    spdlog::info("Presenting with {} across {} images", to_string(negotiated.mode), negotiated.image_count);
 
-    swapchain_extent = ::vk::Extent2D {width, height};
+    if (caps.currentExtent.width != std::numeric_limits<std::uint32_t>::max()) {
+        swapchain_extent = caps.currentExtent;
+    } else {
+        swapchain_extent = ::vk::Extent2D {
+            std::clamp(width, caps.minImageExtent.width, caps.maxImageExtent.width),
+            std::clamp(height, caps.minImageExtent.height, caps.maxImageExtent.height)
+        };
+    }
+    ::vk::UniqueSwapchainKHR old_swapchain = std::move(swapchain);
     swapchain = device.logical->createSwapchainKHRUnique (
         ::vk::SwapchainCreateInfoKHR { 
             .flags = {},
             .surface = *surface,
-            .minImageCount = caps.minImageCount + 1,
+            .minImageCount = negotiated.image_count,
             .imageFormat = win_image_format,
             .imageColorSpace = win_color_space,
             .imageExtent = swapchain_extent,
@@ -244,14 +393,85 @@ void si::vk::renderer::reset_swapchain(std::uint32_t width, std::uint32_t height
             .pQueueFamilyIndices = nullptr,
             .preTransform = caps.currentTransform,
             .compositeAlpha = ::vk::CompositeAlphaFlagBitsKHR::eOpaque,
-            .presentMode = ::vk::PresentModeKHR::eMailbox,
+            .presentMode = negotiated.mode,
             .clipped = true,
-            .oldSwapchain = nullptr
+            .oldSwapchain = old_swapchain ? *old_swapchain : ::vk::SwapchainKHR{}
         }
     );
+    if (old_swapchain) {
+        // Frames already submitted may still be rendering into the old images
+        retired_swapchains.push_back (
+            retired_swapchain {
+                .swapchain = std::move(old_swapchain),
+                .image_views = std::move(swapchain_image_views),
+                .framebuffers = std::move(framebuffers),
+                .last_serial = frame_serial
+            }
+        );
+        swapchain_image_views.clear();
+        framebuffers.clear();
+    }
+}
+void si::vk::renderer::recreate_swapchain() {
+    reset_swapchain(wanted_extent.width, wanted_extent.height);
+    reset_swapchain_images();
+    reset_framebuffers(swapchain_extent.width, swapchain_extent.height);
+    swapchain_stale = false;
+}
+std::uint64_t si::vk::renderer::completed_serial() {
+    std::uint64_t completed = frame_serial;
+    for (frame_context& frame : frames) {
+        if (frame.serial != 0 && device.logical->getFenceStatus(*frame.in_flight) != ::vk::Result::eSuccess) {
+            completed = std::min(completed, frame.serial - 1);
+        }
+    }
+    return completed;
+}
+void si::vk::renderer::collect_retired() {
+    const std::uint64_t completed = completed_serial();
+    text.collect(completed);
+    uploads.collect_waits(completed);
+    std::erase_if(retired_swapchains, [&](const retired_swapchain& r) { return r.last_serial <= completed; });
+}
+void si::vk::renderer::reset_offscreen_images() {
+    offscreen_images.clear();
+    offscreen_memory.clear();
+    // One per frame in flight, so a frame never waits for another's image
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        ::vk::UniqueImage image = device.logical->createImageUnique (
+            ::vk::ImageCreateInfo {
+                .flags = {},
+                .imageType = ::vk::ImageType::e2D,
+                .format = win_image_format,
+                .extent = {swapchain_extent.width, swapchain_extent.height, 1},
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = ::vk::SampleCountFlagBits::e1,
+                .tiling = ::vk::ImageTiling::eOptimal,
+                .usage = ::vk::ImageUsageFlagBits::eColorAttachment | ::vk::ImageUsageFlagBits::eTransferSrc,
+                .sharingMode = ::vk::SharingMode::eExclusive,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+                .initialLayout = ::vk::ImageLayout::eUndefined
+            }
+        );
+        const ::vk::MemoryRequirements memory_reqs = device.logical->getImageMemoryRequirements(*image);
+        allocation memory = device.allocator->allocate(memory_reqs, device.find_memory_type_index(memory_reqs, ::vk::MemoryPropertyFlagBits::eDeviceLocal), resource_kind::optimal);
+        device.logical->bindImageMemory(*image, memory.memory, memory.offset);
+        offscreen_images.push_back(std::move(image));
+        offscreen_memory.push_back(std::move(memory));
+    }
 }
 void si::vk::renderer::reset_swapchain_images() {
-    swapchain_images = device.logical->getSwapchainImagesKHR(*swapchain);
+    if (headless()) {
+        swapchain_images.clear();
+        for (const ::vk::UniqueImage& image : offscreen_images) {
+            swapchain_images.push_back(*image);
+        }
+    } else {
+        swapchain_images = device.logical->getSwapchainImagesKHR(*swapchain);
+    }
+    image_serials.assign(swapchain_images.size(), 0);
     swapchain_image_views.clear();
     swapchain_image_views.reserve(swapchain_images.size());
     for (::vk::Image& img : swapchain_images) {
@@ -283,323 +503,182 @@ void si::vk::renderer::reset_swapchain_images() {
 std::uint32_t si::vk::gfx_device::find_memory_type_index(::vk::MemoryRequirements reqs, ::vk::MemoryPropertyFlags flags) {
     ::vk::PhysicalDeviceMemoryProperties mem_props = physical.getMemoryProperties();
     for (std::uint32_t i = 0; i < mem_props.memoryTypeCount; i++) {
-        if (reqs.memoryTypeBits & (i << 1) // see if the memory is of the ith type
+        if (reqs.memoryTypeBits & (1u << i) // see if the memory is of the ith type
             && (mem_props.memoryTypes[i].propertyFlags & flags) == flags) {
             return i;
         }
     }
     throw std::runtime_error("Can't find memory type satisfying given properties or requirements");
 }
-std::tuple<::vk::UniqueBuffer, ::vk::UniqueDeviceMemory> si::vk::gfx_device::make_buffer (
+::vk::SharingMode si::vk::gfx_device::upload_sharing_mode() const {
+    return transfer_q_family_ix == graphics_q_family_ix ? ::vk::SharingMode::eExclusive : ::vk::SharingMode::eConcurrent;
+}
+std::array<std::uint32_t, 2> si::vk::gfx_device::upload_queue_families() const {
+    return {graphics_q_family_ix, transfer_q_family_ix};
+}
+std::tuple<::vk::UniqueBuffer, si::vk::allocation> si::vk::gfx_device::make_buffer (
     ::vk::DeviceSize buffer_size,
     ::vk::BufferUsageFlags buffer_usage,
     ::vk::SharingMode sharing_mode,
     ::vk::MemoryPropertyFlags memory_flags
 ) {
+    const auto families = upload_queue_families();
+    const bool concurrent = sharing_mode == ::vk::SharingMode::eConcurrent;
     ::vk::UniqueBuffer buffer = logical->createBufferUnique (
         ::vk::BufferCreateInfo {
             .flags = {},
             .size = buffer_size,
             .usage = buffer_usage,
             .sharingMode = sharing_mode,
-            .queueFamilyIndexCount = 0,
-            .pQueueFamilyIndices = nullptr
+            .queueFamilyIndexCount = concurrent ? static_cast<std::uint32_t>(families.size()) : 0,
+            .pQueueFamilyIndices = concurrent ? families.data() : nullptr
         }
     );
     ::vk::MemoryRequirements memory_reqs = logical->getBufferMemoryRequirements(*buffer);
     std::uint32_t memory_type = find_memory_type_index(memory_reqs, memory_flags);
-    ::vk::UniqueDeviceMemory buffer_memory = logical->allocateMemoryUnique (
-        ::vk::MemoryAllocateInfo {
-            .allocationSize = memory_reqs.size,
-            .memoryTypeIndex = memory_type
-        },
-        nullptr
-    );
-    logical->bindBufferMemory(*buffer, *buffer_memory, 0);
+    si::vk::allocation buffer_memory = allocator->allocate(memory_reqs, memory_type, resource_kind::linear);
+    logical->bindBufferMemory(*buffer, buffer_memory.memory, buffer_memory.offset);
     return std::make_tuple(std::move(buffer), std::move(buffer_memory));
 }
 void si::vk::renderer::reset_vertex_buffer() {
-    auto [staging_buffer, staging_buffer_memory, size] = stage(vertices.begin(), vertices.end());
+    const staging_region staged = uploads.stage(vertices.begin(), vertices.end());
     std::tie(vertex_buffer, vertex_buffer_memory) = device.make_buffer (
-        size,
+        staged.size,
         ::vk::BufferUsageFlagBits::eVertexBuffer | ::vk::BufferUsageFlagBits::eTransferDst,
-        ::vk::SharingMode::eExclusive,
+        device.upload_sharing_mode(),
         ::vk::MemoryPropertyFlagBits::eDeviceLocal
     );
-    copy(*staging_buffer, *vertex_buffer, {0, 0, size});
+    resources_ready = uploads.copy(staged.buffer, *vertex_buffer, {staged.offset, 0, staged.size});
 }
 void si::vk::renderer::reset_index_buffer() {
-    auto [staging_buffer, staging_buffer_memory, size] = stage(indices.begin(), indices.end());
+    const staging_region staged = uploads.stage(indices.begin(), indices.end());
     std::tie(index_buffer, index_buffer_memory) = device.make_buffer (
-        size,
+        staged.size,
         ::vk::BufferUsageFlagBits::eIndexBuffer | ::vk::BufferUsageFlagBits::eTransferDst,
-        ::vk::SharingMode::eExclusive,
+        device.upload_sharing_mode(),
         ::vk::MemoryPropertyFlagBits::eDeviceLocal
     );
-    copy(*staging_buffer, *index_buffer, {0, 0, size});
+    resources_ready = uploads.copy(staged.buffer, *index_buffer, {staged.offset, 0, staged.size});
 }
-void si::vk::renderer::reset_uniform_buffers() {
-    uniform_buffers.clear();
-    uniform_buffers.resize(swapchain_images.size());
-    uniform_buffer_memories.clear();
-    uniform_buffer_memories.resize(swapchain_images.size());
-    for (unsigned i = 0; i < swapchain_images.size(); i++) {
-        std::tie(uniform_buffers[i], uniform_buffer_memories[i]) = device.make_buffer (
-            ::vk::DeviceSize { sizeof(uniform_buffer_object) },
-            ::vk::BufferUsageFlagBits::eUniformBuffer,
-            ::vk::SharingMode::eExclusive,
-            ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+void si::vk::renderer::reset_frames(std::uint32_t frames_in_flight) {
+    if (frames_in_flight == 0) {
+        throw std::runtime_error("Need at least one frame in flight");
+    }
+    std::vector<::vk::UniqueCommandBuffer> cmds = device.logical->allocateCommandBuffersUnique (
+        ::vk::CommandBufferAllocateInfo {
+            .commandPool = *graphics_command_pool,
+            .level = ::vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = frames_in_flight
+        }
+    );
+    frames.clear();
+    frames.reserve(frames_in_flight);
+    for (::vk::UniqueCommandBuffer& cmd : cmds) {
+        frames.push_back (
+            frame_context {
+                .image_available = device.logical->createSemaphoreUnique({}),
+                .render_finished = device.logical->createSemaphoreUnique({}),
+                .in_flight = device.logical->createFenceUnique({::vk::FenceCreateFlagBits::eSignaled}),
+                .command_buffer = std::move(cmd)
+            }
         );
+        frames.back().workers.resize(recorders.size());
+        for (recording_worker& worker : frames.back().workers) {
+            // Reset as a whole each time the frame is recorded, not buffer by buffer
+            worker.pool = device.logical->createCommandPoolUnique({::vk::CommandPoolCreateFlagBits::eTransient, device.graphics_q_family_ix});
+        }
+    }
+    current_frame = 0;
+}
+void si::vk::renderer::reset_uniform_buffers() {
+    // One buffer with a slot per frame in flight, bound once and selected with a dynamic offset.
+    const ::vk::DeviceSize alignment = device.physical.getProperties().limits.minUniformBufferOffsetAlignment;
+    uniform_stride = (sizeof(uniform_buffer_object) + alignment - 1) / alignment * alignment;
+    std::tie(uniform_buffer, uniform_buffer_memory) = device.make_buffer (
+        uniform_stride * frames.size(),
+        ::vk::BufferUsageFlagBits::eUniformBuffer,
+        ::vk::SharingMode::eExclusive,
+        ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        frames[i].uniform_offset = static_cast<std::uint32_t>(i * uniform_stride);
     }
 }
 void si::vk::renderer::reset_descriptor_pool() {
     auto pool_sizes = std::array {
         // UBO pool
         ::vk::DescriptorPoolSize {
-            .type = ::vk::DescriptorType::eUniformBuffer,
-            .descriptorCount = static_cast<std::uint32_t>(swapchain_images.size())
-        },
-        // Sampler pool
-        ::vk::DescriptorPoolSize {
-            .type = ::vk::DescriptorType::eCombinedImageSampler,
-            .descriptorCount = static_cast<std::uint32_t>(swapchain_images.size())
+            .type = ::vk::DescriptorType::eUniformBufferDynamic,
+            .descriptorCount = 1
         }
     };
     descriptor_pool = device.logical->createDescriptorPoolUnique (
         ::vk::DescriptorPoolCreateInfo {
             .flags = {},
-            .maxSets = static_cast<std::uint32_t>(swapchain_images.size()),
+            .maxSets = 1,
             .poolSizeCount = static_cast<std::uint32_t>(pool_sizes.size()),
             .pPoolSizes = pool_sizes.data()
         }
     );
 }
 void si::vk::renderer::reset_descriptor_sets() {
-    std::vector<::vk::DescriptorSetLayout> descriptor_set_layouts(swapchain_images.size(), *descriptor_set_layout);
-    descriptor_sets = device.logical->allocateDescriptorSets (
+    descriptor_set = device.logical->allocateDescriptorSets (
         ::vk::DescriptorSetAllocateInfo {
             .descriptorPool = *descriptor_pool,
-            .descriptorSetCount = static_cast<std::uint32_t>(swapchain_images.size()),
-            .pSetLayouts = descriptor_set_layouts.data()
+            .descriptorSetCount = 1,
+            .pSetLayouts = std::to_address(descriptor_set_layout)
         }
+    ).front();
+    auto buffer_info = ::vk::DescriptorBufferInfo {
+        .buffer = *uniform_buffer,
+        .offset = 0,
+        .range = sizeof(uniform_buffer_object)
+    };
+    device.logical->updateDescriptorSets (
+        std::array {
+            ::vk::WriteDescriptorSet {
+                 .dstSet = descriptor_set,
+                 .dstBinding = 0,
+                 .dstArrayElement = 0,
+                 .descriptorCount = 1,
+                 .descriptorType = ::vk::DescriptorType::eUniformBufferDynamic,
+                 .pImageInfo = nullptr,
+                 .pBufferInfo = &buffer_info,
+                 .pTexelBufferView = nullptr
+            }
+        },
+        std::array<::vk::CopyDescriptorSet, 0> {}
     );
-    for (std::size_t i = 0 ; i < swapchain_images.size(); i++) {
-        auto buffer_info = ::vk::DescriptorBufferInfo {
-            .buffer = *uniform_buffers[i],
-            .offset = 0,
-            .range = sizeof(uniform_buffer_object)
-        };
-        auto image_info = ::vk::DescriptorImageInfo {
-            .sampler = *texture_sampler,
-            .imageView = *texture_image_view,
-            .imageLayout = ::vk::ImageLayout::eShaderReadOnlyOptimal
-        };
-        device.logical->updateDescriptorSets (
-            std::array {
-                ::vk::WriteDescriptorSet {
-                     .dstset = descriptor_sets[i],
-                     .dstBinding = 0,
-                     .dstArrayElement = 0,
-                     .descriptorCount = 1,
-                     .descriptorType = ::vk::DescriptorType::eUniformBuffer,
-                     .pImageInfo = nullptr,
-                     .pBufferInfo = &buffer_info,
-                     .pTexelBufferView = nullptr
-                },
-                ::vk::WriteDescriptorSet {
-                     .dstSet = descriptor_sets[i],
-                     .dstBinding = 1,
-                     .dstArrayElement = 0,
-                     .descriptorCount = 1,
-                     .descriptorType = ::vk::DescriptorType::eCombinedImageSampler,
-                     .pImageInfo = &image_info,
-                     .pBufferInfo = nullptr,
-                     .pTexelBufferView = nullptr
-                 }
-            },
-            std::array<::vk::CopyDescriptorSet, 0> {}
-        );
-    }
 }
 
-#include <FreeImage.h>
-//TODO: Make more robust
-struct bitmap {
-    const unsigned width;
-    const unsigned height;
-    const unsigned depth;
-    std::vector<unsigned char> data;
-    const ::vk::Format format = ::vk::Format::eB8G8R8A8Srgb;
-    const unsigned char* begin() const {
-        return std::to_address(data.begin());
-    }
-    const unsigned char* end() const {
-        return std::to_address(data.end());
-    }
-};
-bitmap load_bitmap(std::string filepath) {
-    spdlog::debug("Using FreeImage version {}", FreeImage_GetVersion());
-    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filepath.c_str());
-    if (!format) {
-        throw std::runtime_error("Couldn't determine image format!");
-    } else {
-        const char* format_mime = FreeImage_GetFIFMimeType(format);
-        spdlog::info("Loading {} as {}", filepath, format_mime);
-    }
-    std::unique_ptr<FIBITMAP, decltype(&FreeImage_Unload)> bitmap{FreeImage_Load(format, filepath.c_str()), FreeImage_Unload};
-    if (!bitmap) {
-        bitmap.release();
-        throw std::runtime_error("Couldn't load image!");
-    }
-    const unsigned width = FreeImage_GetWidth(bitmap.get());
-    const unsigned height = FreeImage_GetHeight(bitmap.get());
-    const unsigned depth = FreeImage_GetBPP(bitmap.get());
-    std::vector<unsigned char> raw(width * height * depth);
-    const unsigned pitch = FreeImage_GetPitch(bitmap.get());
-    FreeImage_ConvertToRawBits(raw.data(), bitmap.get(), pitch, depth, FI_RGBA_BLUE_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_RED_MASK, FALSE);
-    return {width, height, depth, std::move(raw)};
-}
-void si::vk::renderer::image_layout_stage0(::vk::Image& img, ::vk::Format format) {
-    auto barrier = ::vk::ImageMemoryBarrier {
-        .srcAccessMask = ::vk::AccessFlags{},
-        .dstAccessMask = ::vk::AccessFlagBits::eTransferWrite,
-        .oldLayout = ::vk::ImageLayout::eUndefined,
-        .newLayout = ::vk::ImageLayout::eTransferDstOptimal,
-        .srcQueueFamilyIndex = 0,
-        .dstQueueFamilyIndex = 0,
-        .image = img,
-        .subresourceRange = ::vk::ImageSubresourceRange {
-            .aspectMask = ::vk::ImageAspectFlagBits::eColor,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        }
-    };
-    run_oneshot (
-        [&](::vk::CommandBuffer& cmd) {
-            cmd.pipelineBarrier (
-                ::vk::PipelineStageFlagBits::eTopOfPipe, ::vk::PipelineStageFlagBits::eTransfer,
-                ::vk::DependencyFlags{},
-                0, nullptr,
-                0, nullptr,
-                1, &barrier
-            );
-        }
-    );
+si::texture_region si::vk::renderer::load_texture(std::string filepath) {
+    const si::texture_region region = textures.add(filepath);
+    resources_ready = std::max(resources_ready, textures.ready());
+    return region;
 }
-void si::vk::renderer::image_layout_stage1(::vk::Image& img, ::vk::Format format) {
-    auto barrier = ::vk::ImageMemoryBarrier {
-        .srcAccessMask = ::vk::AccessFlagBits::eTransferWrite,
-        .dstAccessMask = ::vk::AccessFlagBits::eShaderRead,
-        .oldLayout = ::vk::ImageLayout::eTransferDstOptimal,
-        .newLayout = ::vk::ImageLayout::eShaderReadOnlyOptimal,
-        .srcQueueFamilyIndex = 0,
-        .dstQueueFamilyIndex = 0,
-        .image = img,
-        .subresourceRange = ::vk::ImageSubresourceRange {
-            .aspectMask = ::vk::ImageAspectFlagBits::eColor,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        }
-    };
-    run_oneshot([&](::vk::CommandBuffer& cmd) {
-        cmd.pipelineBarrier (
-            ::vk::PipelineStageFlagBits::eTransfer, ::vk::PipelineStageFlagBits::eFragmentShader,
-            ::vk::DependencyFlags{},
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-        );
-    });
+std::uint32_t si::vk::renderer::stream_texture(std::string filepath) {
+    return textures.add_streamed(std::move(filepath));
 }
-void si::vk::renderer::reset_texture_image(std::string filepath) {
-    auto bmp = load_bitmap(filepath);
-    auto [staging_buffer, staging_buffer_memory, size] = stage(bmp.begin(), bmp.end());
-    texture_image = device.logical->createImageUnique (
-        ::vk::ImageCreateInfo {
-            .flags = {},
-            .imageType = ::vk::ImageType::e2D,
-            .format = bmp.format,
-            .extent = {bmp.width, bmp.height, 1},
-            .mipLevels = 1,
-            .arrayLayers = 1,
-            .samples = ::vk::SampleCountFlagBits::e1,
-            .tiling = ::vk::ImageTiling::eOptimal,
-            .usage = ::vk::ImageUsageFlagBits::eTransferDst | ::vk::ImageUsageFlagBits::eSampled,
-            .sharingMode = ::vk::SharingMode::eExclusive,
-            .queueFamilyIndexCount = 0,
-            .pQueueFamilyIndices = nullptr,
-            .initialLayout = ::vk::ImageLayout::eUndefined
-        }
-    );
-    ::vk::MemoryRequirements memory_reqs = device.logical->getImageMemoryRequirements(*texture_image);
-    std::uint32_t memory_type = device.find_memory_type_index(memory_reqs, ::vk::MemoryPropertyFlagBits::eDeviceLocal);
-    texture_image_memory = device.logical->allocateMemoryUnique (
-        ::vk::MemoryAllocateInfo {
-            .allocationSize = memory_reqs.size,
-            .memoryTypeIndex = memory_type
-        },
-        nullptr
-    );
-    device.logical->bindImageMemory(*texture_image, *texture_image_memory, {});
-    image_layout_stage0(*texture_image, bmp.format);
-    copy (
-        *staging_buffer,
-        *texture_image,
-        ::vk::BufferImageCopy {
-            .bufferOffset = 0,
-            .bufferRowLength = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource = ::vk::ImageSubresourceLayers {
-                .aspectMask = ::vk::ImageAspectFlagBits::eColor,
-                .mipLevel = 0,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-            .imageOffset = {0, 0, 0},
-            .imageExtent = {bmp.width, bmp.height, 1},
-        }
-    );
-    image_layout_stage1(*texture_image, bmp.format);
-    texture_image_view = device.logical->createImageViewUnique (
-        ::vk::ImageViewCreateInfo {
-            .flags = {},
-            .image = *texture_image,
-            .viewType = ::vk::ImageViewType::e2D,
-            .format = bmp.format,
-            .components = ::vk::ComponentMapping{},
-            .subresourceRange = ::vk::ImageSubresourceRange {
-                .aspectMask = ::vk::ImageAspectFlagBits::eColor,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1
-            }
-        }
-    );
-    texture_sampler = device.logical->createSamplerUnique (
-        ::vk::SamplerCreateInfo {
-            .flags = ::vk::SamplerCreateFlags{},
-            .magFilter = ::vk::Filter::eLinear,
-            .minFilter = ::vk::Filter::eLinear,
-            .mipmapMode = ::vk::SamplerMipmapMode::eLinear,
-            .addressModeU = ::vk::SamplerAddressMode::eRepeat,
-            .addressModeV = ::vk::SamplerAddressMode::eRepeat,
-            .addressModeW = ::vk::SamplerAddressMode::eRepeat,
-            .mipLodBias = 0.0f,
-            .anisotropyEnable = true,
-            .maxAnisotropy = 16,
-            .compareEnable = false,
-            .compareOp = ::vk::CompareOp::eAlways,
-            .minLod = 0.0f,
-            .maxLod = 0.0f,
-            .borderColor = ::vk::BorderColor::eIntOpaqueBlack,
-            .unnormalizedCoordinates = false
-        }
-    );
+si::texture_region si::vk::renderer::streamed_region(std::uint32_t stream) const {
+    return textures.region(stream);
+}
+void si::vk::renderer::wake_on_decode(std::function<void()> wake) {
+    textures.notify_decoded(std::move(wake));
+}
+void si::vk::renderer::add_rect(const si::rect& r) {
+    rects.add(r);
+    scene_changed = true;
+}
+void si::vk::renderer::add_text(const si::text& t) {
+    text.add(rects, t);
+    resources_ready = std::max(resources_ready, text.ready());
+    scene_changed = true;
+}
+void si::vk::renderer::clear() {
+    // Frames up to now draw the old scene; its glyphs can go once they've finished
+    text.end_scene(frame_serial);
+    rects.clear();
+    scene_changed = true;
 }
 void si::vk::renderer::reset_framebuffers(std::uint32_t width, std::uint32_t height) {
     framebuffers.clear();
@@ -620,157 +699,528 @@ void si::vk::renderer::reset_framebuffers(std::uint32_t width, std::uint32_t hei
         );
     }
 }
-void si::vk::renderer::reset_command_buffers(std::uint32_t width, std::uint32_t height) {
-    command_buffers = device.logical->allocateCommandBuffersUnique (
-        ::vk::CommandBufferAllocateInfo {
-            .commandPool = *graphics_command_pool,
-            .level = ::vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = static_cast<std::uint32_t>(framebuffers.size())
+std::optional<std::vector<::vk::Rect2D>> si::vk::renderer::image_damage(std::uint32_t swapchain_image_ix) const {
+    const std::uint64_t drawn = image_serials[swapchain_image_ix];
+    if (drawn == 0 || damage_history.empty() || damage_history.front().serial > drawn + 1) {
+        return std::nullopt;
+    }
+    std::vector<::vk::Rect2D> damage;
+    for (const frame_damage& d : damage_history) {
+        if (d.serial <= drawn) {
+            continue;
+        } else if (d.full) {
+            return std::nullopt;
+        }
+        damage.insert(damage.end(), d.rects.begin(), d.rects.end());
+    }
+    // Past a handful of scissors, replaying the scene per rect costs more than one bounding box
+    constexpr std::size_t max_rects = 8;
+    if (damage.size() > max_rects) {
+        std::int32_t x0 = damage.front().offset.x, y0 = damage.front().offset.y, x1 = x0, y1 = y0;
+        for (const ::vk::Rect2D& r : damage) {
+            x0 = std::min(x0, r.offset.x);
+            y0 = std::min(y0, r.offset.y);
+            x1 = std::max(x1, r.offset.x + static_cast<std::int32_t>(r.extent.width));
+            y1 = std::max(y1, r.offset.y + static_cast<std::int32_t>(r.extent.height));
+        }
+        damage.assign(1, ::vk::Rect2D {{x0, y0}, {static_cast<std::uint32_t>(x1 - x0), static_cast<std::uint32_t>(y1 - y0)}});
+    }
+    return damage;
+}
+void si::vk::renderer::record_command_buffer(frame_context& frame, std::uint32_t swapchain_image_ix, const std::optional<std::vector<::vk::Rect2D>>& damage) {
+    const ::vk::ClearValue clear_color {
+        .color = ::vk::ClearColorValue{std::array{0.0f, 0.0f, 0.0f, 0.0f}}
+    };
+    const ::vk::Rect2D whole ({0, 0}, swapchain_extent);
+    // Partial redraws keep the image's contents and only touch the damaged rects
+    const std::vector<::vk::Rect2D> scissors = damage ? *damage : std::vector { whole };
+    ::vk::Rect2D render_area = whole;
+    if (damage) {
+        std::int32_t x0 = swapchain_extent.width, y0 = swapchain_extent.height, x1 = 0, y1 = 0;
+        for (const ::vk::Rect2D& r : scissors) {
+            x0 = std::min(x0, r.offset.x);
+            y0 = std::min(y0, r.offset.y);
+            x1 = std::max(x1, r.offset.x + static_cast<std::int32_t>(r.extent.width));
+            y1 = std::max(y1, r.offset.y + static_cast<std::int32_t>(r.extent.height));
         }
+        render_area = ::vk::Rect2D {{x0, y0}, {static_cast<std::uint32_t>(std::max(x1 - x0, 0)), static_cast<std::uint32_t>(std::max(y1 - y0, 0))}};
+    }
+    const ::vk::RenderPass pass = damage ? *render_pass_load : *render_pass;
+    // Looked up here because get_pipeline may build one, which mustn't happen on several threads at once
+    const ::vk::Pipeline backdrop_pipeline = get_pipeline(pipeline_variant{});
+    std::vector<::vk::Pipeline> batch_pipelines;
+    std::uint32_t instance_count = 0;
+    for (const batch_draw& batch : frame.draws) {
+        batch_pipelines.push_back(get_pipeline(batch.variant));
+        instance_count += batch.instance_count;
+    }
+    // Every damaged rect is redrawn in chunks of the rects, one secondary
+    // each. Executed in order, so each rect's clear and backdrop still come
+    // first, and overlapping scissors are cleared before they're redrawn.
+    const std::uint32_t chunks = std::clamp<std::uint32_t> (
+        (instance_count + min_instances_per_secondary - 1) / min_instances_per_secondary,
+        1, static_cast<std::uint32_t>(recorders.size())
     );
-    for (std::size_t i = 0; i < command_buffers.size(); i++) {
-        ::vk::CommandBuffer& cmd = *command_buffers[i];
-        cmd.begin(::vk::CommandBufferBeginInfo {});
-        const ::vk::ClearValue clear_color {
-            .color = ::vk::ClearColorValue{std::array{0.0f, 0.0f, 0.0f, 0.0f}}
-        };
-        const ::vk::Rect2D scissor ({0, 0}, {width, height});
-        cmd.beginRenderPass (
-            ::vk::RenderPassBeginInfo {
-                .renderPass = *render_pass,
-                .framebuffer = *framebuffers[i],
-                .renderArea = scissor,
-                .clearValueCount = 1,
-                .pClearValues = &clear_color
-            },
-            ::vk::SubpassContents::eInline
+    const std::uint32_t per_chunk = (instance_count + chunks - 1) / chunks;
+    for (recording_worker& worker : frame.workers) {
+        device.logical->resetCommandPool(*worker.pool, {});
+        worker.used = 0;
+    }
+    const auto viewport = ::vk::Viewport {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(swapchain_extent.width),
+        .height = static_cast<float>(swapchain_extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    const std::array sets { descriptor_set, textures.descriptor_set() };
+    const si::texture_region backdrop_region = textures.region(backdrop);
+    const push_constants quad {
+        .model = glm::mat4{1.0f},
+        .region = {backdrop_region.x, backdrop_region.y, backdrop_region.width, backdrop_region.height},
+        .texture = backdrop_region.texture
+    };
+    const push_constants pixels {
+        .model = glm::scale (
+            glm::translate(glm::mat4{1.0f}, glm::vec3{-1.0f, 1.0f, 0.0f}),
+            glm::vec3{2.0f / swapchain_extent.width, -2.0f / swapchain_extent.height, 1.0f}
+        ),
+        .region = {},
+        .texture = 0
+    };
+    const ::vk::CommandBufferInheritanceInfo inheritance {
+        .renderPass = pass,
+        .subpass = 0,
+        .framebuffer = *framebuffers[swapchain_image_ix],
+        .occlusionQueryEnable = false,
+        .queryFlags = {},
+        // Must match the statistics query open around the render pass
+        .pipelineStatistics = profiler.has_statistics() ? gpu_profiler::statistic_flags : ::vk::QueryPipelineStatisticFlags {}
+    };
+    std::vector<::vk::CommandBuffer> secondaries(scissors.size() * chunks);
+    recorders.parallel_for(secondaries.size(), [&](std::size_t item, std::size_t worker_ix) {
+        const ::vk::Rect2D& scissor = scissors[item / chunks];
+        const std::uint32_t chunk = item % chunks;
+        recording_worker& worker = frame.workers[worker_ix];
+        if (worker.used == worker.secondaries.size()) {
+            std::vector<::vk::UniqueCommandBuffer> allocated = device.logical->allocateCommandBuffersUnique (
+                ::vk::CommandBufferAllocateInfo {
+                    .commandPool = *worker.pool,
+                    .level = ::vk::CommandBufferLevel::eSecondary,
+                    .commandBufferCount = 1
+                }
+            );
+            worker.secondaries.push_back(std::move(allocated.front()));
+        }
+        ::vk::CommandBuffer cmd = *worker.secondaries[worker.used++];
+        cmd.begin (
+            ::vk::CommandBufferBeginInfo {
+                .flags = ::vk::CommandBufferUsageFlagBits::eRenderPassContinue | ::vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+                .pInheritanceInfo = &inheritance
+            }
         );
-        cmd.bindPipeline(::vk::PipelineBindPoint::eGraphics, *pipeline);
-        const auto viewport = ::vk::Viewport {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(width),
-            .height = static_cast<float>(height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
-        };
+        // Secondaries inherit no state, so each sets up its own
         cmd.setViewport(0, viewport);
         cmd.setScissor(0, scissor);
-        std::array<::vk::Buffer, 1> buffers = { *vertex_buffer };
-        std::array<::vk::DeviceSize, 1> offsets = { 0 };
-        cmd.bindVertexBuffers(0, 1, buffers.data(), offsets.data());
         cmd.bindIndexBuffer(*index_buffer, ::vk::DeviceSize {0}, ::vk::IndexType::eUint16);
-        cmd.bindDescriptorSets(::vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, 1, &descriptor_sets[i], 0, nullptr);
-        cmd.drawIndexed(indices.size(), 1, 0, 0, 0);
-        cmd.endRenderPass();
+        cmd.bindDescriptorSets(::vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, sets.size(), sets.data(), 1, &frame.uniform_offset);
+        if (chunk == 0) {
+            if (damage) {
+                cmd.clearAttachments (
+                    ::vk::ClearAttachment {
+                        .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                        .colorAttachment = 0,
+                        .clearValue = clear_color
+                    },
+                    ::vk::ClearRect { .rect = scissor, .baseArrayLayer = 0, .layerCount = 1 }
+                );
+            }
+            cmd.bindPipeline(::vk::PipelineBindPoint::eGraphics, backdrop_pipeline);
+            std::array<::vk::Buffer, 1> buffers = { *vertex_buffer };
+            std::array<::vk::DeviceSize, 1> offsets = { 0 };
+            cmd.bindVertexBuffers(0, 1, buffers.data(), offsets.data());
+            cmd.pushConstants(*pipeline_layout, ::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment, 0, sizeof(quad), &quad);
+            cmd.drawIndexed(indices.size(), 1, 0, 0, 0);
+        }
+        const std::uint32_t begin = chunk * per_chunk;
+        const std::uint32_t end = std::min(instance_count, begin + per_chunk);
+        if (begin < end) {
+            // Rects reuse the quad's indices; the vertex shader turns them into corners
+            const ::vk::DeviceSize instance_offset = 0;
+            cmd.bindVertexBuffers(0, 1, &*frame.instance_buffer, &instance_offset);
+            cmd.pushConstants(*pipeline_layout, ::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment, 0, sizeof(pixels), &pixels);
+            for (std::size_t i = 0; i < frame.draws.size(); i++) {
+                const batch_draw& batch = frame.draws[i];
+                const std::uint32_t first = std::max(begin, batch.first_instance);
+                const std::uint32_t last = std::min(end, batch.first_instance + batch.instance_count);
+                if (first < last) {
+                    cmd.bindPipeline(::vk::PipelineBindPoint::eGraphics, batch_pipelines[i]);
+                    cmd.drawIndexed(indices.size(), last - first, 0, 0, first);
+                }
+            }
+        }
         cmd.end();
+        secondaries[item] = cmd;
+    });
+    ::vk::CommandBuffer& cmd = *frame.command_buffer;
+    cmd.reset({});
+    cmd.begin(::vk::CommandBufferBeginInfo { .flags = ::vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    profiler.begin_frame(cmd, current_frame, frame.serial);
+    const std::uint32_t pass_scope = profiler.begin(cmd, damage ? "partial redraw" : "redraw", true);
+    cmd.beginRenderPass (
+        ::vk::RenderPassBeginInfo {
+            .renderPass = pass,
+            .framebuffer = *framebuffers[swapchain_image_ix],
+            .renderArea = render_area,
+            .clearValueCount = 1,
+            .pClearValues = &clear_color
+        },
+        ::vk::SubpassContents::eSecondaryCommandBuffers
+    );
+    cmd.executeCommands(secondaries);
+    cmd.endRenderPass();
+    profiler.end(cmd, pass_scope);
+    if (readback) {
+        record_readback(frame, swapchain_image_ix);
     }
+    cmd.end();
 }
-void si::vk::renderer::update_uniform_buffers(unsigned ix) {
+void si::vk::renderer::record_readback(frame_context& frame, std::uint32_t image_ix) {
+    if (frame.readback_extent != swapchain_extent) {
+        std::tie(frame.readback_buffer, frame.readback_memory) = device.make_buffer (
+            ::vk::DeviceSize{swapchain_extent.width} * swapchain_extent.height * sizeof(std::uint32_t),
+            ::vk::BufferUsageFlagBits::eTransferDst,
+            ::vk::SharingMode::eExclusive,
+            ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+        frame.readback_extent = swapchain_extent;
+    }
+    ::vk::CommandBuffer& cmd = *frame.command_buffer;
+    // The render pass has already moved the image to target_layout
+    cmd.pipelineBarrier (
+        ::vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        ::vk::PipelineStageFlagBits::eTransfer,
+        {},
+        ::vk::MemoryBarrier {
+            .srcAccessMask = ::vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = ::vk::AccessFlagBits::eTransferRead
+        },
+        nullptr,
+        nullptr
+    );
+    cmd.copyImageToBuffer (
+        swapchain_images[image_ix],
+        ::vk::ImageLayout::eTransferSrcOptimal,
+        *frame.readback_buffer,
+        ::vk::BufferImageCopy {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = ::vk::ImageSubresourceLayers {
+                .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {swapchain_extent.width, swapchain_extent.height, 1},
+        }
+    );
+    cmd.pipelineBarrier (
+        ::vk::PipelineStageFlagBits::eTransfer,
+        ::vk::PipelineStageFlagBits::eHost,
+        {},
+        ::vk::MemoryBarrier {
+            .srcAccessMask = ::vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = ::vk::AccessFlagBits::eHostRead
+        },
+        nullptr,
+        nullptr
+    );
+}
+void si::vk::renderer::update_uniform_buffers(frame_context& frame) {
     using clock = std::chrono::high_resolution_clock;
     static auto start = clock::now();
     auto now = clock::now();
     float time = std::chrono::duration<float, std::chrono::seconds::period>(now - start).count();
     uniform_buffer_object ubo = {
-        .model = glm::mat4{1.0f}, //glm::rotate(glm::mat4(1.0f), time * glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
         .view = glm::mat4{1.0f}, //glm::lookAt(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
         .proj = glm::mat4{1.0f}, //glm::perspective(glm::radians(45.0f), swapchain_extent.width / static_cast<float>(swapchain_extent.height), 0.1f, 10.0f)
     };
     ubo.proj[1][1] *= -1.0f; // glm's y clip-space axis is opposite to vulkans
-    void* data = device.logical->mapMemory(*uniform_buffer_memories[ix], 0, sizeof(ubo));
-    std::copy(&ubo, &ubo + 1, reinterpret_cast<uniform_buffer_object*>(data));
-    device.logical->unmapMemory(*uniform_buffer_memories[ix]);
-}
-void si::vk::renderer::copy(::vk::Buffer src, ::vk::Buffer dst, ::vk::BufferCopy what) {
-    run_oneshot(
-        [&](::vk::CommandBuffer& cmd) {
-            cmd.copyBuffer(src, dst, what);
-        }
-    );
+    std::copy(&ubo, &ubo + 1, reinterpret_cast<uniform_buffer_object*>(uniform_buffer_memory.mapped() + frame.uniform_offset));
 }
-void si::vk::renderer::copy(::vk::Buffer src, ::vk::Image dst, ::vk::BufferImageCopy what) {
-    run_oneshot(
-        [&](::vk::CommandBuffer& cmd) {
-            cmd.copyBufferToImage(src, dst, ::vk::ImageLayout::eTransferDstOptimal, what);
-        }
-    );
+void si::vk::renderer::update_instance_buffer(frame_context& frame) {
+    const std::size_t count = rects.size();
+    if (count > frame.instance_capacity) {
+        // Grow geometrically so a growing scene doesn't reallocate every frame
+        frame.instance_capacity = std::max<std::size_t>(count, frame.instance_capacity * 2);
+        std::tie(frame.instance_buffer, frame.instance_memory) = device.make_buffer (
+            frame.instance_capacity * sizeof(rect_instance),
+            ::vk::BufferUsageFlagBits::eVertexBuffer,
+            ::vk::SharingMode::eExclusive,
+            ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+    }
+    frame.draws = count ? rects.write(reinterpret_cast<rect_instance*>(frame.instance_memory.mapped())) : std::vector<batch_draw>{};
 }
-si::vk::renderer::renderer(si::vk::gfx_device& device, ::vk::UniqueSurfaceKHR old_surface, std::uint32_t width, std::uint32_t height):
+si::vk::renderer::renderer(si::vk::gfx_device& device, ::vk::UniqueSurfaceKHR old_surface, std::uint32_t width, std::uint32_t height, present_policy policy, std::uint32_t frames_in_flight, bool readback):
     device(device),
-    swapchain_image_available(device.logical->createSemaphoreUnique({})),
-    render_finished(device.logical->createSemaphoreUnique({})),
-    in_flight(device.logical->createFenceUnique({::vk::FenceCreateFlagBits::eSignaled})),
-    surface(std::move(old_surface)) {
+    surface(std::move(old_surface)),
+    readback(readback),
+    target_layout(surface ? ::vk::ImageLayout::ePresentSrcKHR : ::vk::ImageLayout::eTransferSrcOptimal),
+    policy(policy),
+    // Power saving halves a 60Hz display's rate
+    min_frame_interval(policy == present_policy::power_saver ? 33 : 0),
+    profiler(device, frames_in_flight),
+    uploads(device),
+    textures(device, uploads),
+    text(textures, uploads) {
     reset_descriptor_set_layout();
     reset_pipeline();
-    graphics_command_pool = device.logical->createCommandPoolUnique({{}, device.graphics_q_family_ix});
+    graphics_command_pool = device.logical->createCommandPoolUnique({::vk::CommandPoolCreateFlagBits::eResetCommandBuffer, device.graphics_q_family_ix});
+    // Before the swapchain, since headless renderers make an image per frame
+    reset_frames(frames_in_flight);
     reset_swapchain(width, height);
     reset_swapchain_images();
-    reset_framebuffers(width, height);
+    reset_framebuffers(swapchain_extent.width, swapchain_extent.height);
     reset_vertex_buffer();
     reset_index_buffer();
     reset_uniform_buffers();
     reset_descriptor_pool();
-    reset_texture_image("wintex2.png");
+    backdrop = stream_texture("wintex2.png");
     reset_descriptor_sets();
-    reset_command_buffers(width, height);
+    uploads.flush();
 }
 
+bool si::vk::renderer::headless() const {
+    return !surface;
+}
+si::vk::frame_pixels si::vk::renderer::read_pixels() {
+    if (!headless() || !readback) {
+        throw std::runtime_error("Only headless renderers made with readback can read pixels back");
+    }
+    const frame_context& last = frames[(current_frame + frames.size() - 1) % frames.size()];
+    if (last.serial == 0) {
+        throw std::runtime_error("Nothing has been drawn to read back");
+    }
+    device.logical->waitForFences(*last.in_flight, true, std::numeric_limits<std::uint64_t>::max());
+    frame_pixels pixels { .extent = last.readback_extent, .argb = std::vector<std::uint32_t>(std::size_t{last.readback_extent.width} * last.readback_extent.height) };
+    std::memcpy(pixels.argb.data(), last.readback_memory.mapped(), pixels.argb.size() * sizeof(std::uint32_t));
+    return pixels;
+}
 void si::vk::renderer::resize(std::uint32_t width, std::uint32_t height) {
-    device.logical->waitIdle();
-    reset_swapchain(width, height);
-    reset_swapchain_images();
-    reset_framebuffers(width, height);
-    reset_uniform_buffers();
-    reset_descriptor_pool();
-    reset_descriptor_sets();
-    reset_command_buffers(width, height);
+    // Recreated lazily by the next draw, so a burst of configures during an
+    // interactive resize only rebuilds once per frame, and never idles the device.
+    if (width != swapchain_extent.width || height != swapchain_extent.height) {
+        wanted_extent = ::vk::Extent2D {width, height};
+        swapchain_stale = true;
+    }
 }
 
 si::vk::renderer::~renderer() {
     device.logical->waitIdle();
+    const upload_stats& uploaded = uploads.stats();
+    spdlog::debug (
+        "Uploads: {} bytes in {} staging ring slices ({} stalls), {} oversized, {} Vulkan objects created",
+        uploaded.ring_bytes, uploaded.ring_uploads, uploaded.ring_stalls, uploaded.oversized_uploads, uploaded.objects_created
+    );
+    const allocator_stats stats = device.allocator->stats();
+    spdlog::debug (
+        "Device memory: {} sub-allocations in {} device allocations, {}/{} bytes used, {:.1f} allocs/s, {:.0f}% internal / {:.0f}% external fragmentation",
+        stats.live_allocations, stats.device_allocations, stats.used_bytes, stats.reserved_bytes,
+        stats.allocations_per_second, stats.internal_fragmentation * 100.0, stats.external_fragmentation * 100.0
+    );
+    spdlog::debug("Frames: {} submitted", frame_serial);
+    if (const auto& timed = profiler.frames(); !timed.empty()) {
+        double total_ms = 0.0;
+        for (const gpu_frame_timing& f : timed) {
+            for (const gpu_scope_timing& scope : f.scopes) {
+                total_ms += scope.depth == 0 ? scope.duration_ms : 0.0;
+            }
+        }
+        spdlog::debug("GPU: {:.3f} ms per frame over the last {} frames", total_ms / timed.size(), timed.size());
+    }
+    if (const char* trace = std::getenv("SI_GPU_TRACE"); trace && *trace) {
+        const std::string contents = profiler.chrome_trace();
+        try {
+            si::write_file_contents(trace, std::vector<std::byte>(reinterpret_cast<const std::byte*>(contents.data()), reinterpret_cast<const std::byte*>(contents.data() + contents.size())));
+        } catch (const std::exception& e) {
+            spdlog::warn("Couldn't write GPU trace to {}: {}", trace, e.what());
+        }
+    }
+    const text_stats& glyphs = text.stats();
+    spdlog::debug (
+        "Text: {} glyph hits, {} misses, {} shelf evictions, {} dropped; {} shaping hits, {} misses",
+        glyphs.glyph_hits, glyphs.glyph_misses, glyphs.shelf_evictions, glyphs.glyphs_dropped, glyphs.shaping_hits, glyphs.shaping_misses
+    );
 }
 
-void si::vk::renderer::draw() {
-    device.logical->waitForFences(*in_flight, true, std::numeric_limits<std::uint64_t>::max());
-    device.logical->resetFences(*in_flight);
-    auto [result, swapchain_image_ix] = device.logical->acquireNextImageKHR (
-        *swapchain,
-        std::numeric_limits<std::uint64_t>::max(),
-        *swapchain_image_available,
-        nullptr
-    );
-    update_uniform_buffers(swapchain_image_ix);
-    ::vk::PipelineStageFlags pipeline_stage = ::vk::PipelineStageFlagBits::eColorAttachmentOutput;
+bool si::vk::renderer::needs_redraw() const {
+    return full_damage || scene_changed || !pending_damage.empty() || swapchain_stale || textures.streaming();
+}
+bool si::vk::renderer::draw() {
+    // A streamed texture swapping in can change any rect that samples it
+    if (textures.update()) {
+        full_damage = true;
+    }
+    // Submits uploads of anything just decoded, even if there's nothing to draw yet
+    uploads.flush();
+    scene_changed = false;
+    rects.collect_damage(pending_damage);
+    std::erase_if(pending_damage, [&](::vk::Rect2D& r) {
+        const std::optional<::vk::Rect2D> visible = clip(r, swapchain_extent);
+        r = visible.value_or(r);
+        return !visible;
+    });
+    if (!full_damage && pending_damage.empty() && !swapchain_stale) {
+        return false;
+    }
+    // Only wait for the frame that last used this context; the others may still be in flight.
+    frame_context& frame = frames[current_frame];
+    uploads.flush();
+    // The first frames can't be drawn until the startup uploads have landed.
+    resources_ready.wait();
+    device.logical->waitForFences(*frame.in_flight, true, std::numeric_limits<std::uint64_t>::max());
+    collect_retired();
+    std::uint32_t swapchain_image_ix;
+    for (;;) {
+        if (swapchain_stale) {
+            recreate_swapchain();
+        }
+        if (headless()) {
+            // Nothing to acquire: the image is this frame's own
+            swapchain_image_ix = current_frame;
+            break;
+        }
+        try {
+            auto [result, image_ix] = device.logical->acquireNextImageKHR (
+                *swapchain,
+                std::numeric_limits<std::uint64_t>::max(),
+                *frame.image_available,
+                nullptr
+            );
+            // A suboptimal image can still be presented; rebuild for the next frame
+            if (result == ::vk::Result::eSuboptimalKHR) {
+                wanted_extent = swapchain_extent;
+                swapchain_stale = true;
+            }
+            swapchain_image_ix = image_ix;
+            break;
+        } catch (const ::vk::OutOfDateKHRError&) {
+            wanted_extent = swapchain_extent;
+            swapchain_stale = true;
+        }
+    }
+    device.logical->resetFences(*frame.in_flight);
+    frame.serial = ++frame_serial;
+    damage_history.push_back(frame_damage { .serial = frame.serial, .full = full_damage, .rects = std::move(pending_damage) });
+    pending_damage.clear();
+    full_damage = false;
+    if (damage_history.size() > max_damage_history) {
+        damage_history.pop_front();
+    }
+    const std::optional<std::vector<::vk::Rect2D>> damage = image_damage(swapchain_image_ix);
+    update_uniform_buffers(frame);
+    update_instance_buffer(frame);
+    record_command_buffer(frame, swapchain_image_ix, damage);
+    image_serials[swapchain_image_ix] = frame.serial;
+    // Drawing into the image waits for the acquire; reading vertices and
+    // sampling textures wait for whatever the transfer queue uploaded
+    std::vector<::vk::Semaphore> waits;
+    std::vector<::vk::PipelineStageFlags> wait_stages;
+    if (!headless()) {
+        waits.push_back(*frame.image_available);
+        wait_stages.push_back(::vk::PipelineStageFlagBits::eColorAttachmentOutput);
+    }
+    for (::vk::Semaphore uploaded : uploads.take_waits(frame.serial)) {
+        waits.push_back(uploaded);
+        wait_stages.push_back(::vk::PipelineStageFlagBits::eVertexInput | ::vk::PipelineStageFlagBits::eFragmentShader);
+    }
+    if (headless()) {
+        // No present to signal; the fence alone says when it's done
+        device.graphics_q.submit (
+            ::vk::SubmitInfo {
+                static_cast<std::uint32_t>(waits.size()), waits.data(),
+                wait_stages.data(),
+                1, &*frame.command_buffer,
+                0, nullptr
+            },
+            *frame.in_flight
+        );
+        current_frame = (current_frame + 1) % frames.size();
+        return true;
+    }
     device.graphics_q.submit (
         ::vk::SubmitInfo {
-            1, &*swapchain_image_available,
-            &pipeline_stage,
-            1, &*command_buffers[swapchain_image_ix],
-            1, &*render_finished
+            static_cast<std::uint32_t>(waits.size()), waits.data(),
+            wait_stages.data(),
+            1, &*frame.command_buffer,
+            1, &*frame.render_finished
         },
-        *in_flight
+        *frame.in_flight
     );
-    device.present_q.presentKHR (
-        ::vk::PresentInfoKHR {
-            1, &*render_finished,
-            1, &*swapchain,
-            &swapchain_image_ix
+    // The compositor only needs to recomposite what changed since the last image it was given
+    std::vector<::vk::RectLayerKHR> changed;
+    if (!damage_history.back().full) {
+        for (const ::vk::Rect2D& r : damage_history.back().rects) {
+            changed.push_back(::vk::RectLayerKHR { .offset = r.offset, .extent = r.extent, .layer = 0 });
         }
-    );
+    }
+    const ::vk::PresentRegionKHR present_region {
+        .rectangleCount = static_cast<std::uint32_t>(changed.size()),
+        .pRectangles = changed.data()
+    };
+    const ::vk::PresentRegionsKHR present_regions {
+        .swapchainCount = 1,
+        .pRegions = &present_region
+    };
+    ::vk::PresentInfoKHR present_info {
+        1, &*frame.render_finished,
+        1, &*swapchain,
+        &swapchain_image_ix
+    };
+    if (device.incremental_present && !changed.empty()) {
+        present_info.pNext = &present_regions;
+    }
+    try {
+        const ::vk::Result presented = device.present_q.presentKHR(present_info);
+        if (presented == ::vk::Result::eSuboptimalKHR && !swapchain_stale) {
+            wanted_extent = swapchain_extent;
+            swapchain_stale = true;
+        }
+    } catch (const ::vk::OutOfDateKHRError&) {
+        if (!swapchain_stale) {
+            wanted_extent = swapchain_extent;
+            swapchain_stale = true;
+        }
+    }
+    current_frame = (current_frame + 1) % frames.size();
+    return true;
+}
+void si::vk::renderer::invalidate() {
+    full_damage = true;
+}
+void si::vk::renderer::invalidate(::vk::Rect2D area) {
+    pending_damage.push_back(area);
 }
 
-si::vk::gfx_device::gfx_device(::vk::PhysicalDevice physical, ::vk::Queue graphics_q, std::uint32_t graphics_q_family_ix, ::vk::Queue present_q, std::uint32_t present_q_family_ix, ::vk::UniqueDevice device):
+si::vk::gfx_device::gfx_device(::vk::PhysicalDevice physical, ::vk::Queue graphics_q, std::uint32_t graphics_q_family_ix, ::vk::Queue present_q, std::uint32_t present_q_family_ix, ::vk::Queue transfer_q, std::uint32_t transfer_q_family_ix, ::vk::UniqueDevice device):
     physical(physical),
     graphics_q(graphics_q),
     graphics_q_family_ix(graphics_q_family_ix),
     present_q(present_q),
     present_q_family_ix(present_q_family_ix),
-    logical(std::move(device)) {
+    transfer_q(transfer_q),
+    transfer_q_family_ix(transfer_q_family_ix),
+    logical(std::move(device)),
+    allocator(std::make_unique<memory_allocator>(physical, *logical)),
+    pipelines(std::make_unique<pipeline_cache>(physical, *logical)) {
 }
 
-std::unique_ptr<si::vk::renderer> si::vk::gfx_device::make_renderer(::vk::UniqueSurfaceKHR surface, std::uint32_t width, std::uint32_t height) {
-    return std::make_unique<si::vk::renderer>(*this, std::move(surface), width, height);
+std::unique_ptr<si::vk::renderer> si::vk::gfx_device::make_renderer(::vk::UniqueSurfaceKHR surface, std::uint32_t width, std::uint32_t height, present_policy policy, std::uint32_t frames_in_flight, bool readback) {
+    return std::make_unique<si::vk::renderer>(*this, std::move(surface), width, height, policy, frames_in_flight, readback);
 }
 
 namespace {
@@ -810,8 +1260,21 @@ namespace {
             spdlog::info(" * {}", extension.extensionName);
         }
 
-        auto layers = std::vector { "VK_LAYER_LUNARG_standard_validation" };
-        auto extensions = std::vector { "VK_KHR_surface", "VK_KHR_wayland_surface", "VK_EXT_debug_utils", "VK_EXT_debug_report" };
+        // Build machines may have neither validation layers nor a windowing system
+        const auto available_layers = vk::enumerateInstanceLayerProperties();
+        const auto available_extensions = vk::enumerateInstanceExtensionProperties();
+        std::vector<const char*> layers;
+        for (const char* wanted : { "VK_LAYER_LUNARG_standard_validation" }) {
+            if (std::any_of(available_layers.begin(), available_layers.end(), [&](const vk::LayerProperties& l) { return std::string_view(l.layerName) == wanted; })) {
+                layers.push_back(wanted);
+            }
+        }
+        auto extensions = std::vector { "VK_EXT_debug_utils", "VK_EXT_debug_report" };
+        for (const char* wanted : { "VK_KHR_surface", "VK_KHR_wayland_surface" }) {
+            if (std::any_of(available_extensions.begin(), available_extensions.end(), [&](const vk::ExtensionProperties& e) { return std::string_view(e.extensionName) == wanted; })) {
+                extensions.push_back(wanted);
+            }
+        }
         vk::UniqueInstance vk = vk::createInstanceUnique ({
             {},
             &app_info,
@@ -841,59 +1304,111 @@ namespace {
 }
 si::vk::root::root(): instance(make_instance()), debug_reporter(attach_debug_reporter(*instance)) {
 }
-std::unique_ptr<si::vk::renderer> si::vk::root::make_renderer(::wl::display& display, ::wl::surface& surface, std::uint32_t width, std::uint32_t height) {
-    // Optimistically make a vulkan surface
-    ::vk::UniqueSurfaceKHR vk_surface = instance->createWaylandSurfaceKHRUnique ({
-        {}, static_cast<wl_display*>(display), static_cast<wl_surface*>(surface)
-    });
-    auto gfx_it = std::find_if(gfxs.begin(), gfxs.end(), [&](const si::vk::gfx_device& gfx) {
-        return gfx.physical.getSurfaceSupportKHR(gfx.present_q_family_ix, *vk_surface);
+si::vk::gfx_device& si::vk::root::get_device(::vk::SurfaceKHR surface) {
+    auto gfx_it = std::find_if(gfxs.begin(), gfxs.end(), [&](const std::unique_ptr<si::vk::gfx_device>& gfx) {
+        return !surface || (gfx->presentable && gfx->physical.getSurfaceSupportKHR(gfx->present_q_family_ix, surface));
     });
     if (gfx_it != gfxs.end()) {
-        return gfx_it->make_renderer(std::move(vk_surface), width, height);
-    } else {
-        for (::vk::PhysicalDevice& physical : instance->enumeratePhysicalDevices()) {
-            auto props = physical.getProperties();
-            spdlog::debug("Device max viewports: {} up to {}x{}", props.limits.maxViewports, props.limits.maxViewportDimensions[0], props.limits.maxViewportDimensions[1]);
-            std::vector<::vk::ExtensionProperties> exts_avail = physical.enumerateDeviceExtensionProperties();
-            //TODO: actually check if the required extensions are available
-            //TODO: check for anisotropy support
-            if (true) {
-                std::vector<::vk::QueueFamilyProperties> queue_families = physical.getQueueFamilyProperties();
-                std::vector<::vk::DeviceQueueCreateInfo> queue_infos;
-                const float queue_priority = 0.0f;
-                std::optional<std::uint32_t> graphics_q_ix;
-                std::optional<std::uint32_t> present_q_ix;
-                for (std::size_t i = 0; i < queue_families.size(); i++) {
-                    queue_infos.push_back({{}, static_cast<std::uint32_t>(i), 0, &queue_priority});
-                    if (queue_families[i].queueFlags & ::vk::QueueFlagBits::eGraphics) {
-                        graphics_q_ix = i;
-                        queue_infos[i].queueCount = 1;
-                        spdlog::info("Found graphics queue family");
-                    }
-                    if (physical.getSurfaceSupportKHR(i, *vk_surface)) {
-                        present_q_ix = i;
-                        queue_infos[i].queueCount = 1;
-                        spdlog::info("Found present queue family");
-                    }
-                }
-                if (graphics_q_ix && present_q_ix) {
-                    ::vk::PhysicalDeviceFeatures features = physical.getFeatures();
-                    ::vk::DeviceCreateInfo device_info (
-                        {},
-                        static_cast<std::uint32_t>(queue_infos.size()), queue_infos.data(),
-                        0, nullptr, // device layers are deprecated
-                        static_cast<std::uint32_t>(exts_required.size()), exts_required.data(),
-                        &features
-                    );
-                    ::vk::UniqueDevice logical = physical.createDeviceUnique(device_info);
-                    ::vk::Queue graphics_q = logical->getQueue(*graphics_q_ix, 0);
-                    ::vk::Queue present_q = logical->getQueue(*present_q_ix, 0);
-                    gfx_device& created = gfxs.emplace_back(physical, graphics_q, *graphics_q_ix, present_q, *present_q_ix, std::move(logical));
-                    return created.make_renderer(std::move(vk_surface), width, height);
-                }
+        return **gfx_it;
+    }
+    for (::vk::PhysicalDevice& physical : instance->enumeratePhysicalDevices()) {
+        auto props = physical.getProperties();
+        spdlog::debug("Device max viewports: {} up to {}x{}", props.limits.maxViewports, props.limits.maxViewportDimensions[0], props.limits.maxViewportDimensions[1]);
+        std::vector<::vk::ExtensionProperties> exts_avail = physical.enumerateDeviceExtensionProperties();
+        auto has_ext = [&](std::string_view name) {
+            return std::any_of(exts_avail.begin(), exts_avail.end(), [&](const ::vk::ExtensionProperties& ext) {
+                return std::string_view(ext.extensionName) == name;
+            });
+        };
+        // Headless devices (lavapipe on a build machine, say) needn't be able to present
+        const bool has_exts = std::all_of(exts_required.begin(), exts_required.end(), [&](const char* required) {
+            return (!surface && std::string_view(required) == "VK_KHR_swapchain") || has_ext(required);
+        });
+        auto features = physical.getFeatures2<::vk::PhysicalDeviceFeatures2, ::vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+        const auto& indexing = features.get<::vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+        const bool has_indexing = indexing.shaderSampledImageArrayNonUniformIndexing
+            && indexing.descriptorBindingPartiallyBound
+            && indexing.descriptorBindingSampledImageUpdateAfterBind
+            && indexing.descriptorBindingUpdateUnusedWhilePending;
+        if (!has_exts || !has_indexing) {
+            spdlog::info("Skipping {}: missing required extensions or descriptor indexing features", props.deviceName);
+            continue;
+        }
+        std::vector<const char*> exts_enabled;
+        for (const char* ext : exts_required) {
+            if (has_ext(ext)) {
+                exts_enabled.push_back(ext);
             }
         }
-        throw std::runtime_error("Can't create a renderer for supplied wayland display/surface");
+        const bool has_incremental_present = has_ext("VK_KHR_incremental_present");
+        if (has_incremental_present) {
+            exts_enabled.push_back("VK_KHR_incremental_present");
+        }
+        //TODO: check for anisotropy support
+        std::vector<::vk::QueueFamilyProperties> queue_families = physical.getQueueFamilyProperties();
+        std::vector<::vk::DeviceQueueCreateInfo> queue_infos;
+        const float queue_priority = 0.0f;
+        std::optional<std::uint32_t> graphics_q_ix;
+        std::optional<std::uint32_t> present_q_ix;
+        std::optional<std::uint32_t> transfer_q_ix;
+        for (std::size_t i = 0; i < queue_families.size(); i++) {
+            queue_infos.push_back({{}, static_cast<std::uint32_t>(i), 0, &queue_priority});
+            if (queue_families[i].queueFlags & ::vk::QueueFlagBits::eGraphics) {
+                graphics_q_ix = i;
+                queue_infos[i].queueCount = 1;
+                spdlog::info("Found graphics queue family");
+            }
+            if (surface && physical.getSurfaceSupportKHR(i, surface)) {
+                present_q_ix = i;
+                queue_infos[i].queueCount = 1;
+                spdlog::info("Found present queue family");
+            }
+            const auto flags = queue_families[i].queueFlags;
+            if (!transfer_q_ix && (flags & ::vk::QueueFlagBits::eTransfer) && !(flags & (::vk::QueueFlagBits::eGraphics | ::vk::QueueFlagBits::eCompute))) {
+                transfer_q_ix = i;
+                queue_infos[i].queueCount = 1;
+                spdlog::info("Found dedicated transfer queue family");
+            }
+        }
+        if (!surface) {
+            // Nothing is presented; the graphics queue stands in
+            present_q_ix = graphics_q_ix;
+        }
+        if (graphics_q_ix && present_q_ix) {
+            // Features are enabled through the pNext chain so the descriptor indexing ones come along
+            ::vk::DeviceCreateInfo device_info (
+                {},
+                static_cast<std::uint32_t>(queue_infos.size()), queue_infos.data(),
+                0, nullptr, // device layers are deprecated
+                static_cast<std::uint32_t>(exts_enabled.size()), exts_enabled.data(),
+                nullptr
+            );
+            device_info.pNext = &features.get<::vk::PhysicalDeviceFeatures2>();
+            ::vk::UniqueDevice logical = physical.createDeviceUnique(device_info);
+            ::vk::Queue graphics_q = logical->getQueue(*graphics_q_ix, 0);
+            ::vk::Queue present_q = logical->getQueue(*present_q_ix, 0);
+            // Graphics queues implicitly support transfers
+            ::vk::Queue transfer_q = transfer_q_ix ? logical->getQueue(*transfer_q_ix, 0) : graphics_q;
+            gfx_device& created = *gfxs.emplace_back(std::make_unique<gfx_device>(physical, graphics_q, *graphics_q_ix, present_q, *present_q_ix, transfer_q, transfer_q_ix.value_or(*graphics_q_ix), std::move(logical)));
+            created.presentable = has_ext("VK_KHR_swapchain");
+            created.incremental_present = has_incremental_present;
+            // Statistics around a render pass of secondaries need them to inherit the query
+            const ::vk::PhysicalDeviceFeatures& core = features.get<::vk::PhysicalDeviceFeatures2>().features;
+            created.pipeline_statistics = core.pipelineStatisticsQuery && core.inheritedQueries;
+            return created;
+        }
     }
+    throw std::runtime_error(surface ? "Can't find a device able to present to the surface" : "Can't find a device able to render");
+}
+std::unique_ptr<si::vk::renderer> si::vk::root::make_renderer(::wl::display& display, ::wl::surface& surface, std::uint32_t width, std::uint32_t height, present_policy policy, std::uint32_t frames_in_flight) {
+    // Optimistically make a vulkan surface
+    ::vk::UniqueSurfaceKHR vk_surface = instance->createWaylandSurfaceKHRUnique ({
+        {}, static_cast<wl_display*>(display), static_cast<wl_surface*>(surface)
+    });
+    gfx_device& gfx = get_device(*vk_surface);
+    return gfx.make_renderer(std::move(vk_surface), width, height, policy, frames_in_flight);
+}
+std::unique_ptr<si::vk::renderer> si::vk::root::make_headless_renderer(std::uint32_t width, std::uint32_t height, bool readback, std::uint32_t frames_in_flight) {
+    gfx_device& gfx = get_device(nullptr);
+    return gfx.make_renderer(nullptr, width, height, present_policy::smooth, frames_in_flight, readback);
 }
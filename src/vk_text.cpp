@@ -0,0 +1,197 @@
+#include <si/vk_text.hpp>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace {
+    constexpr std::size_t no_shelf = std::numeric_limits<std::size_t>::max();
+}
+
+si::vk::glyph_atlas::glyph_atlas(texture_manager& textures, uploader& uploads, text_stats& counters):
+    uploads(uploads),
+    page(textures.add_coverage({size, size})),
+    counters(counters) {
+}
+std::optional<std::size_t> si::vk::glyph_atlas::make_room(std::uint32_t w, std::uint32_t h, std::uint64_t scene, std::uint64_t evictable) {
+    std::optional<std::size_t> best;
+    for (std::size_t i = 0; i < shelves.size(); i++) {
+        if (shelves[i].height >= h && size - shelves[i].used_width >= w && (!best || shelves[i].height < shelves[*best].height)) {
+            best = i;
+        }
+    }
+    if (best) {
+        return best;
+    }
+    // Rounding shelf heights up lets glyphs of nearby sizes share them after eviction
+    const std::uint32_t height = (h + 3) & ~3u;
+    if (size - used_height >= height) {
+        shelves.push_back(shelf { .y = used_height, .height = height });
+        used_height += height;
+        return shelves.size() - 1;
+    }
+    for (std::size_t i = 0; i < shelves.size(); i++) {
+        const shelf& s = shelves[i];
+        if (s.height >= h && s.last_scene <= evictable && (!best || s.last_scene < shelves[*best].last_scene)) {
+            best = i;
+        }
+    }
+    if (best) {
+        shelf& victim = shelves[*best];
+        for (const glyph_key& key : victim.glyphs) {
+            glyphs.erase(key);
+        }
+        victim.glyphs.clear();
+        victim.used_width = 0;
+        counters.shelf_evictions++;
+    }
+    return best;
+}
+const si::vk::cached_glyph* si::vk::glyph_atlas::find(const glyph_key& key, std::uint64_t scene) {
+    auto it = glyphs.find(key);
+    if (it == glyphs.end()) {
+        return nullptr;
+    }
+    counters.glyph_hits++;
+    if (it->second.shelf != no_shelf) {
+        shelves[it->second.shelf].last_scene = scene;
+    }
+    return &it->second;
+}
+const si::vk::cached_glyph* si::vk::glyph_atlas::insert(const glyph_key& key, const unsigned char* coverage, std::uint32_t width, std::uint32_t height, std::int32_t pitch, std::int32_t left, std::int32_t top, std::uint64_t scene, std::uint64_t evictable) {
+    counters.glyph_misses++;
+    if (width == 0 || height == 0) {
+        // Whitespace: nothing to draw, but worth remembering
+        return &glyphs.insert_or_assign(key, cached_glyph { .region = {}, .left = left, .top = top, .width = 0, .height = 0, .shelf = no_shelf }).first->second;
+    }
+    const std::optional<std::size_t> shelf_ix = make_room(width + 1, height + 1, scene, evictable);
+    if (!shelf_ix) {
+        return nullptr;
+    }
+    shelf& s = shelves[*shelf_ix];
+    const ::vk::Offset2D at {static_cast<std::int32_t>(s.used_width), static_cast<std::int32_t>(s.y)};
+    s.used_width += width + 1;
+    s.last_scene = scene;
+    s.glyphs.push_back(key);
+    // Copies from a transfer-only queue need offsets that are multiples of 4
+    const std::size_t offset = (pending_coverage.size() + 3) & ~std::size_t{3};
+    pending_coverage.resize(offset + std::size_t{width} * height);
+    for (std::uint32_t row = 0; row < height; row++) {
+        std::copy_n(coverage + std::ptrdiff_t{pitch} * row, width, pending_coverage.data() + offset + std::size_t{row} * width);
+    }
+    pending.push_back(pending_copy { .at = at, .width = width, .height = height, .offset = offset });
+    const float scale = 1.0f / size;
+    const cached_glyph glyph {
+        .region = si::texture_region {
+            .texture = page.slot,
+            .x = at.x * scale,
+            .y = at.y * scale,
+            .width = width * scale,
+            .height = height * scale
+        },
+        .left = left,
+        .top = top,
+        .width = width,
+        .height = height,
+        .shelf = *shelf_ix
+    };
+    return &glyphs.insert_or_assign(key, glyph).first->second;
+}
+void si::vk::glyph_atlas::flush() {
+    if (pending.empty()) {
+        return;
+    }
+    const staging_region staged = uploads.stage(pending_coverage.size());
+    std::copy(pending_coverage.begin(), pending_coverage.end(), reinterpret_cast<unsigned char*>(staged.data));
+    std::vector<::vk::BufferImageCopy> regions;
+    regions.reserve(pending.size());
+    for (const pending_copy& p : pending) {
+        regions.push_back (
+            ::vk::BufferImageCopy {
+                .bufferOffset = staged.offset + p.offset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = ::vk::ImageSubresourceLayers {
+                    .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+                .imageOffset = {p.at.x, p.at.y, 0},
+                .imageExtent = {p.width, p.height, 1},
+            }
+        );
+    }
+    uploads.copy(staged.buffer, page.image, regions, ::vk::ImageLayout::eGeneral);
+    latest = uploads.transition(page.image, ::vk::ImageLayout::eGeneral, ::vk::ImageLayout::eGeneral);
+    pending.clear();
+    pending_coverage.clear();
+}
+si::vk::upload si::vk::glyph_atlas::ready() const {
+    return latest;
+}
+
+si::vk::text_renderer::text_renderer(texture_manager& textures, uploader& uploads): atlas(textures, uploads, counters) {
+}
+const si::shaped_run& si::vk::text_renderer::shape(const si::text& t, std::uint32_t face) {
+    shaping_key key { t.content, face, static_cast<std::uint32_t>(std::lround(t.size)) };
+    if (auto it = runs.find(key); it != runs.end()) {
+        counters.shaping_hits++;
+        return it->second;
+    }
+    counters.shaping_misses++;
+    if (runs.size() >= max_runs) {
+        runs.clear();
+    }
+    shaped_run run = fonts.shape(t.content, face, key.size);
+    return runs.emplace(std::move(key), std::move(run)).first->second;
+}
+void si::vk::text_renderer::add(rect_batch& batch, const si::text& t) {
+    const std::uint32_t face = fonts.face(t.font);
+    const shaped_run& run = shape(t, face);
+    for (const shaped_glyph& g : run.glyphs) {
+        const glyph_key key { face, g.glyph, static_cast<std::uint32_t>(std::lround(t.size)) };
+        const cached_glyph* cached = atlas.find(key, scene);
+        if (!cached) {
+            const std::optional<glyph_coverage> c = fonts.render(key);
+            if (!c) {
+                continue;
+            }
+            // Glyphs with no coverage are cached empty, so they aren't rendered again
+            cached = atlas.insert(key, c->pixels, c->width, c->height, c->pitch, c->left, c->top, scene, evictable);
+            if (!cached) {
+                counters.glyphs_dropped++;
+                continue;
+            }
+        }
+        if (cached->width == 0) {
+            continue;
+        }
+        batch.add (
+            si::rect {
+                .x = std::round(t.x) + g.x + cached->left,
+                .y = std::round(t.y) + run.ascender - cached->top,
+                .width = static_cast<float>(cached->width),
+                .height = static_cast<float>(cached->height),
+                .colour = t.colour,
+                .texture = cached->region
+            }
+        );
+    }
+    atlas.flush();
+}
+void si::vk::text_renderer::end_scene(std::uint64_t last_serial) {
+    ended.emplace_back(scene, last_serial);
+    scene++;
+}
+void si::vk::text_renderer::collect(std::uint64_t completed_serial) {
+    while (!ended.empty() && ended.front().second <= completed_serial) {
+        evictable = ended.front().first;
+        ended.pop_front();
+    }
+}
+si::vk::upload si::vk::text_renderer::ready() const {
+    return atlas.ready();
+}
+const si::vk::text_stats& si::vk::text_renderer::stats() const {
+    return counters;
+}
@@ -0,0 +1,604 @@
+#include <si/vk_texture.hpp>
+#include <si/vk_renderer.hpp>
+#include <si/util.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <FreeImage.h>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+    const auto texture_format = ::vk::Format::eB8G8R8A8Srgb;
+
+    // Loads any format FreeImage knows, as 32 bit BGRA. Rows are pitch bytes
+    // apart, which at 32 bits per pixel is always width * 4.
+    std::unique_ptr<FIBITMAP, si::vk::freeimage_deleter> load_bitmap(const std::string& filepath) {
+        spdlog::debug("Using FreeImage version {}", FreeImage_GetVersion());
+        FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filepath.c_str());
+        if (format == FIF_UNKNOWN) {
+            throw std::runtime_error(fmt::format("Couldn't determine the image format of {}", filepath));
+        }
+        spdlog::info("Loading {} as {}", filepath, FreeImage_GetFIFMimeType(format));
+        std::unique_ptr<FIBITMAP, si::vk::freeimage_deleter> bitmap { FreeImage_Load(format, filepath.c_str()) };
+        if (!bitmap) {
+            throw std::runtime_error(fmt::format("Couldn't load {}", filepath));
+        }
+        if (FreeImage_GetImageType(bitmap.get()) != FIT_BITMAP || FreeImage_GetBPP(bitmap.get()) != 32) {
+            bitmap.reset(FreeImage_ConvertTo32Bits(bitmap.get()));
+            if (!bitmap) {
+                throw std::runtime_error(fmt::format("Couldn't convert {} to 32 bits per pixel", filepath));
+            }
+        }
+        return bitmap;
+    }
+
+    // sRGB bytes to linear light, and linear light (at 12 bits) back to sRGB bytes
+    struct srgb_tables {
+        std::array<float, 256> to_linear;
+        std::array<std::uint8_t, 4096> to_srgb;
+        srgb_tables() {
+            for (std::size_t i = 0; i < to_linear.size(); i++) {
+                const float c = i / 255.0f;
+                to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (std::size_t i = 0; i < to_srgb.size(); i++) {
+                const float l = i / 4095.0f;
+                const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                to_srgb[i] = static_cast<std::uint8_t>(std::lround(c * 255.0f));
+            }
+        }
+    };
+    const srgb_tables& srgb() {
+        static const srgb_tables tables;
+        return tables;
+    }
+    std::uint32_t mip_levels(std::uint32_t width, std::uint32_t height) {
+        return std::bit_width(std::max(width, height));
+    }
+    // Halves a BGRA image, averaging 2x2 texels (clamped at odd edges) in linear light
+    void downsample(const std::byte* src, std::uint32_t width, std::uint32_t height, std::byte* dst) {
+        const srgb_tables& tables = srgb();
+        const std::uint32_t dst_width = std::max(width / 2, 1u);
+        const std::uint32_t dst_height = std::max(height / 2, 1u);
+        for (std::uint32_t y = 0; y < dst_height; y++) {
+            const std::size_t row0 = std::size_t{std::min(y * 2, height - 1)} * width;
+            const std::size_t row1 = std::size_t{std::min(y * 2 + 1, height - 1)} * width;
+            for (std::uint32_t x = 0; x < dst_width; x++) {
+                const std::uint32_t x0 = std::min(x * 2, width - 1);
+                const std::uint32_t x1 = std::min(x * 2 + 1, width - 1);
+                const std::array<const std::byte*, 4> texels { src + (row0 + x0) * 4, src + (row0 + x1) * 4, src + (row1 + x0) * 4, src + (row1 + x1) * 4 };
+                std::byte* out = dst + (std::size_t{y} * dst_width + x) * 4;
+                for (int c = 0; c < 3; c++) {
+                    float sum = 0.0f;
+                    for (const std::byte* t : texels) {
+                        sum += tables.to_linear[std::to_integer<std::uint8_t>(t[c])];
+                    }
+                    out[c] = std::byte{tables.to_srgb[std::lround(sum * 0.25f * 4095.0f)]};
+                }
+                unsigned alpha = 2;
+                for (const std::byte* t : texels) {
+                    alpha += std::to_integer<std::uint8_t>(t[3]);
+                }
+                out[3] = std::byte(alpha / 4);
+            }
+        }
+    }
+
+    // Appends levels 1 and up, built from level 0 in bgra, to the image
+    void add_mips(si::vk::decoded_image& image, const std::byte* bgra) {
+        const std::uint32_t count = mip_levels(image.width, image.height);
+        const std::size_t first = image.levels.size();
+        std::size_t offset = image.contents.size();
+        for (std::uint32_t i = 1; i < count; i++) {
+            const std::size_t length = std::size_t{std::max(image.width >> i, 1u)} * std::max(image.height >> i, 1u) * 4;
+            image.levels.push_back(si::vk::image_level { offset, length });
+            offset += length;
+        }
+        // Sized once, so each level can be downsampled from the last in place
+        image.contents.resize(offset);
+        const std::byte* src = bgra;
+        for (std::uint32_t i = 1; i < count; i++) {
+            std::byte* dst = image.contents.data() + image.levels[first + i - 1].offset;
+            downsample(src, std::max(image.width >> (i - 1), 1u), std::max(image.height >> (i - 1), 1u), dst);
+            src = dst;
+        }
+    }
+
+    const std::array<unsigned char, 12> ktx2_identifier { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+    struct ktx2_file {
+        ::vk::Format format;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::vector<si::vk::image_level> levels; // largest first
+        std::vector<std::byte> contents;
+    };
+    // Bytes per block, and texels per block side, of the formats we upload from KTX2
+    struct block_layout {
+        std::uint32_t bytes;
+        std::uint32_t side;
+    };
+    std::optional<block_layout> ktx2_block_layout(::vk::Format format) {
+        switch (format) {
+        case ::vk::Format::eBc1RgbUnormBlock:
+        case ::vk::Format::eBc1RgbSrgbBlock:
+        case ::vk::Format::eBc1RgbaUnormBlock:
+        case ::vk::Format::eBc1RgbaSrgbBlock:
+            return block_layout {8, 4};
+        case ::vk::Format::eBc3UnormBlock:
+        case ::vk::Format::eBc3SrgbBlock:
+        case ::vk::Format::eBc7UnormBlock:
+        case ::vk::Format::eBc7SrgbBlock:
+            return block_layout {16, 4};
+        case ::vk::Format::eR8G8B8A8Unorm:
+        case ::vk::Format::eR8G8B8A8Srgb:
+        case ::vk::Format::eB8G8R8A8Unorm:
+        case ::vk::Format::eB8G8R8A8Srgb:
+            return block_layout {4, 1};
+        default:
+            return std::nullopt;
+        }
+    }
+    bool is_ktx2(const std::string& filepath) {
+        std::array<char, ktx2_identifier.size()> start {};
+        std::ifstream file(filepath, std::ios::binary);
+        return file.read(start.data(), start.size()) && std::memcmp(start.data(), ktx2_identifier.data(), start.size()) == 0;
+    }
+    // Only 2D, single layer, single face textures without supercompression
+    ktx2_file load_ktx2(const std::string& filepath) {
+        ktx2_file ktx { .format = {}, .width = 0, .height = 0, .levels = {}, .contents = si::file_contents(filepath) };
+        const std::vector<std::byte>& c = ktx.contents;
+        // Fields are little endian, as are the hosts we run on
+        auto read = [&]<typename T>(std::size_t offset, T) {
+            if (offset + sizeof(T) > c.size()) {
+                throw std::runtime_error(fmt::format("{} is truncated", filepath));
+            }
+            T value;
+            std::memcpy(&value, c.data() + offset, sizeof(T));
+            return value;
+        };
+        const std::uint32_t format = read(12, std::uint32_t{});
+        ktx.width = read(20, std::uint32_t{});
+        ktx.height = read(24, std::uint32_t{});
+        const std::uint32_t depth = read(28, std::uint32_t{});
+        const std::uint32_t layers = read(32, std::uint32_t{});
+        const std::uint32_t faces = read(36, std::uint32_t{});
+        const std::uint32_t level_count = std::max(read(40, std::uint32_t{}), 1u); // 0 asks the loader to generate them
+        const std::uint32_t supercompression = read(44, std::uint32_t{});
+        if (ktx.width == 0 || ktx.height == 0 || depth != 0 || layers > 1 || faces != 1) {
+            throw std::runtime_error(fmt::format("{} isn't a plain 2D texture", filepath));
+        }
+        if (supercompression != 0) {
+            throw std::runtime_error(fmt::format("{} is supercompressed, which isn't supported", filepath));
+        }
+        // Past a full chain, levels would shift the extent by its whole width
+        if (level_count > mip_levels(ktx.width, ktx.height)) {
+            throw std::runtime_error(fmt::format("{} has {} mip levels, more than a {}x{} image can", filepath, level_count, ktx.width, ktx.height));
+        }
+        ktx.format = static_cast<::vk::Format>(format);
+        const std::optional<block_layout> blocks = ktx2_block_layout(ktx.format);
+        if (!blocks) {
+            throw std::runtime_error(fmt::format("{} is in {}, which isn't supported", filepath, ::vk::to_string(ktx.format)));
+        }
+        // The level index follows the 48 byte header and 32 byte section index
+        for (std::uint32_t i = 0; i < level_count; i++) {
+            const std::size_t entry = 80 + i * 24;
+            const si::vk::image_level level { read(entry, std::uint64_t{}), read(entry + 8, std::uint64_t{}) };
+            const std::uint64_t width = std::max(ktx.width >> i, 1u);
+            const std::uint64_t height = std::max(ktx.height >> i, 1u);
+            const std::uint64_t expected = (width + blocks->side - 1) / blocks->side * ((height + blocks->side - 1) / blocks->side) * blocks->bytes;
+            // Both come from the file, so their sum could wrap around
+            if (level.length < expected || level.offset > c.size() || level.length > c.size() - level.offset) {
+                throw std::runtime_error(fmt::format("{} has a malformed mip level {}", filepath, i));
+            }
+            ktx.levels.push_back(level);
+        }
+        return ktx;
+    }
+}
+
+void si::vk::freeimage_deleter::operator()(FIBITMAP* bitmap) const {
+    FreeImage_Unload(bitmap);
+}
+si::vk::decoded_image si::vk::decode_image(const std::string& filepath, std::uint32_t max_atlased) {
+    if (is_ktx2(filepath)) {
+        ktx2_file ktx = load_ktx2(filepath);
+        spdlog::info("Loaded {} as {} with {} mip levels", filepath, ::vk::to_string(ktx.format), ktx.levels.size());
+        // Levels are staged from where they sit in the file's contents
+        return decoded_image {
+            .format = ktx.format,
+            .width = ktx.width,
+            .height = ktx.height,
+            .bitmap = nullptr,
+            .contents = std::move(ktx.contents),
+            .levels = std::move(ktx.levels)
+        };
+    }
+    decoded_image image { .format = texture_format, .width = 0, .height = 0, .bitmap = load_bitmap(filepath), .contents = {}, .levels = {} };
+    image.width = FreeImage_GetWidth(image.bitmap.get());
+    image.height = FreeImage_GetHeight(image.bitmap.get());
+    if (image.width > max_atlased || image.height > max_atlased) {
+        add_mips(image, reinterpret_cast<const std::byte*>(FreeImage_GetBits(image.bitmap.get())));
+    }
+    return image;
+}
+
+si::vk::shelf_packer::shelf_packer(std::uint32_t width, std::uint32_t height): width(width), height(height) {
+}
+std::optional<::vk::Offset2D> si::vk::shelf_packer::pack(std::uint32_t w, std::uint32_t h) {
+    shelf* best = nullptr;
+    for (shelf& s : shelves) {
+        if (s.height >= h && width - s.used_width >= w && (!best || s.height < best->height)) {
+            best = &s;
+        }
+    }
+    if (!best) {
+        if (w > width || height - used_height < h) {
+            return std::nullopt;
+        }
+        best = &shelves.emplace_back(shelf { .y = used_height, .height = h, .used_width = 0 });
+        used_height += h;
+    }
+    const ::vk::Offset2D at {static_cast<std::int32_t>(best->used_width), static_cast<std::int32_t>(best->y)};
+    best->used_width += w;
+    return at;
+}
+
+si::vk::texture_manager::texture_manager(gfx_device& device, uploader& uploads): device(device), uploads(uploads), decoders(decode_threads + 1) {
+    sampler = device.logical->createSamplerUnique (
+        ::vk::SamplerCreateInfo {
+            .flags = ::vk::SamplerCreateFlags{},
+            .magFilter = ::vk::Filter::eLinear,
+            .minFilter = ::vk::Filter::eLinear,
+            .mipmapMode = ::vk::SamplerMipmapMode::eLinear,
+            // Repeating would sample the neighbouring images in an atlas page
+            .addressModeU = ::vk::SamplerAddressMode::eClampToEdge,
+            .addressModeV = ::vk::SamplerAddressMode::eClampToEdge,
+            .addressModeW = ::vk::SamplerAddressMode::eClampToEdge,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = false,
+            .maxAnisotropy = 1,
+            .compareEnable = false,
+            .compareOp = ::vk::CompareOp::eAlways,
+            .minLod = 0.0f,
+            .maxLod = VK_LOD_CLAMP_NONE,
+            .borderColor = ::vk::BorderColor::eIntOpaqueBlack,
+            .unnormalizedCoordinates = false
+        }
+    );
+    // Slots are filled in as textures arrive, including while earlier frames that don't use them are in flight
+    const ::vk::DescriptorBindingFlagsEXT binding_flags = ::vk::DescriptorBindingFlagBitsEXT::ePartiallyBound
+                                                        | ::vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind
+                                                        | ::vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+    const ::vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info {
+        .bindingCount = 1,
+        .pBindingFlags = &binding_flags
+    };
+    const ::vk::DescriptorSetLayoutBinding binding {
+        .binding = 0,
+        .descriptorType = ::vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = max_textures,
+        .stageFlags = ::vk::ShaderStageFlagBits::eFragment,
+        .pImmutableSamplers = nullptr
+    };
+    layout = device.logical->createDescriptorSetLayoutUnique (
+        ::vk::DescriptorSetLayoutCreateInfo {
+            .pNext = &binding_flags_info,
+            .flags = ::vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT,
+            .bindingCount = 1,
+            .pBindings = &binding
+        }
+    );
+    const ::vk::DescriptorPoolSize pool_size {
+        .type = ::vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = max_textures
+    };
+    pool = device.logical->createDescriptorPoolUnique (
+        ::vk::DescriptorPoolCreateInfo {
+            .flags = ::vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT,
+            .maxSets = 1,
+            .poolSizeCount = 1,
+            .pPoolSizes = &pool_size
+        }
+    );
+    set = device.logical->allocateDescriptorSets (
+        ::vk::DescriptorSetAllocateInfo {
+            .descriptorPool = *pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = std::to_address(layout)
+        }
+    ).front();
+    // Mid grey, opaque
+    placeholder = add_single (
+        decoded_image {
+            .format = texture_format,
+            .width = 1,
+            .height = 1,
+            .bitmap = nullptr,
+            .contents = { std::byte{0x80}, std::byte{0x80}, std::byte{0x80}, std::byte{0xff} },
+            .levels = {{0, 4}}
+        }
+    );
+}
+si::vk::texture si::vk::texture_manager::make_texture(::vk::Extent2D extent, ::vk::ImageLayout image_layout, ::vk::Format format, ::vk::ComponentMapping components, std::uint32_t levels) {
+    const auto families = device.upload_queue_families();
+    const auto sharing_mode = device.upload_sharing_mode();
+    texture tex;
+    tex.extent = extent;
+    tex.image = device.logical->createImageUnique (
+        ::vk::ImageCreateInfo {
+            .flags = {},
+            .imageType = ::vk::ImageType::e2D,
+            .format = format,
+            .extent = {extent.width, extent.height, 1},
+            .mipLevels = levels,
+            .arrayLayers = 1,
+            .samples = ::vk::SampleCountFlagBits::e1,
+            .tiling = ::vk::ImageTiling::eOptimal,
+            .usage = ::vk::ImageUsageFlagBits::eTransferDst | ::vk::ImageUsageFlagBits::eSampled,
+            .sharingMode = sharing_mode,
+            .queueFamilyIndexCount = sharing_mode == ::vk::SharingMode::eConcurrent ? static_cast<std::uint32_t>(families.size()) : 0,
+            .pQueueFamilyIndices = sharing_mode == ::vk::SharingMode::eConcurrent ? families.data() : nullptr,
+            .initialLayout = ::vk::ImageLayout::eUndefined
+        }
+    );
+    ::vk::MemoryRequirements memory_reqs = device.logical->getImageMemoryRequirements(*tex.image);
+    std::uint32_t memory_type = device.find_memory_type_index(memory_reqs, ::vk::MemoryPropertyFlagBits::eDeviceLocal);
+    tex.memory = device.allocator->allocate(memory_reqs, memory_type, resource_kind::optimal);
+    device.logical->bindImageMemory(*tex.image, tex.memory.memory, tex.memory.offset);
+    uploads.transition(*tex.image, ::vk::ImageLayout::eUndefined, image_layout, levels);
+    tex.view = device.logical->createImageViewUnique (
+        ::vk::ImageViewCreateInfo {
+            .flags = {},
+            .image = *tex.image,
+            .viewType = ::vk::ImageViewType::e2D,
+            .format = format,
+            .components = components,
+            .subresourceRange = ::vk::ImageSubresourceRange {
+                .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel = 0,
+                .levelCount = levels,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        }
+    );
+    return tex;
+}
+std::uint32_t si::vk::texture_manager::bind(const texture& tex, ::vk::ImageLayout image_layout) {
+    if (next_slot == max_textures) {
+        throw std::runtime_error("Out of texture slots");
+    }
+    const ::vk::DescriptorImageInfo image_info {
+        .sampler = *sampler,
+        .imageView = *tex.view,
+        .imageLayout = image_layout
+    };
+    device.logical->updateDescriptorSets (
+        ::vk::WriteDescriptorSet {
+            .dstSet = set,
+            .dstBinding = 0,
+            .dstArrayElement = next_slot,
+            .descriptorCount = 1,
+            .descriptorType = ::vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &image_info,
+            .pBufferInfo = nullptr,
+            .pTexelBufferView = nullptr
+        },
+        nullptr
+    );
+    return next_slot++;
+}
+si::texture_region si::vk::texture_manager::add(std::uint32_t width, std::uint32_t height, const std::byte* bgra) {
+    if (width > max_atlased || height > max_atlased) {
+        const std::size_t length = std::size_t{width} * height * 4;
+        decoded_image image { .format = texture_format, .width = width, .height = height, .bitmap = nullptr, .contents = {bgra, bgra + length}, .levels = {{0, length}} };
+        add_mips(image, bgra);
+        return add_single(image);
+    }
+    return add_atlased(width, height, uploads.stage(bgra, bgra + ::vk::DeviceSize{width} * height * 4));
+}
+si::texture_region si::vk::texture_manager::add_atlased(std::uint32_t width, std::uint32_t height, const staging_region& staged) {
+    auto copy_to = [&](::vk::Image img, ::vk::Offset2D at, ::vk::ImageLayout image_layout) {
+        uploads.copy (
+            staged.buffer,
+            img,
+            ::vk::BufferImageCopy {
+                .bufferOffset = staged.offset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = ::vk::ImageSubresourceLayers {
+                    .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+                .imageOffset = {at.x, at.y, 0},
+                .imageExtent = {width, height, 1},
+            },
+            image_layout
+        );
+    };
+    // Pages stay in the general layout so new images can be copied in while
+    // frames in flight are sampling the rest of the page.
+    atlas_page* page = nullptr;
+    std::optional<::vk::Offset2D> at;
+    for (atlas_page& p : pages) {
+        if ((at = p.packer.pack(width + padding, height + padding))) {
+            page = &p;
+            break;
+        }
+    }
+    if (!page) {
+        texture tex = make_texture({page_size, page_size}, ::vk::ImageLayout::eGeneral, texture_format);
+        const std::uint32_t slot = bind(tex, ::vk::ImageLayout::eGeneral);
+        page = &pages.emplace_back(atlas_page { std::move(tex), shelf_packer(page_size, page_size), slot });
+        at = page->packer.pack(width + padding, height + padding);
+        spdlog::debug("Opened texture atlas page {} in slot {}", pages.size(), slot);
+    }
+    copy_to(*page->tex.image, *at, ::vk::ImageLayout::eGeneral);
+    latest = uploads.transition(*page->tex.image, ::vk::ImageLayout::eGeneral, ::vk::ImageLayout::eGeneral);
+    const float scale = 1.0f / page_size;
+    return si::texture_region {
+        .texture = page->slot,
+        .x = at->x * scale,
+        .y = at->y * scale,
+        .width = width * scale,
+        .height = height * scale
+    };
+}
+si::texture_region si::vk::texture_manager::add_single(const decoded_image& image) {
+    if (!can_sample(image.format)) {
+        throw std::runtime_error(fmt::format("{} textures can't be sampled on this device", ::vk::to_string(image.format)));
+    }
+    const std::uint32_t levels = image.level_count();
+    texture tex = make_texture({image.width, image.height}, ::vk::ImageLayout::eTransferDstOptimal, image.format, {}, levels);
+    for (std::uint32_t i = 0; i < levels; i++) {
+        // Block compressed levels go up as they are; the GPU decodes them when sampling
+        const staging_region staged = stage_level(image, i);
+        uploads.copy (
+            staged.buffer,
+            *tex.image,
+            ::vk::BufferImageCopy {
+                .bufferOffset = staged.offset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = ::vk::ImageSubresourceLayers {
+                    .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = i,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+                .imageOffset = {0, 0, 0},
+                .imageExtent = {std::max(image.width >> i, 1u), std::max(image.height >> i, 1u), 1},
+            }
+        );
+    }
+    latest = uploads.transition(*tex.image, ::vk::ImageLayout::eTransferDstOptimal, ::vk::ImageLayout::eShaderReadOnlyOptimal, levels);
+    const std::uint32_t slot = bind(tex, ::vk::ImageLayout::eShaderReadOnlyOptimal);
+    singles.push_back(std::move(tex));
+    return si::texture_region { .texture = slot };
+}
+si::vk::staging_region si::vk::texture_manager::stage_level(const decoded_image& image, std::uint32_t level) {
+    if (image.bitmap) {
+        if (level == 0) {
+            // FreeImage writes the rows into the mapped ring itself, so the
+            // decoded bitmap is the only other copy of the image there is.
+            const unsigned pitch = image.width * 4;
+            const staging_region staged = uploads.stage(::vk::DeviceSize{pitch} * image.height);
+            FreeImage_ConvertToRawBits(reinterpret_cast<BYTE*>(staged.data), image.bitmap.get(), pitch, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+            return staged;
+        }
+        level--;
+    }
+    const auto begin = image.contents.begin() + image.levels[level].offset;
+    return uploads.stage(begin, begin + image.levels[level].length);
+}
+si::texture_region si::vk::texture_manager::add(const decoded_image& image) {
+    if (image.format == texture_format && image.level_count() == 1 && image.width <= max_atlased && image.height <= max_atlased) {
+        return add_atlased(image.width, image.height, stage_level(image, 0));
+    }
+    return add_single(image);
+}
+bool si::vk::texture_manager::can_sample(::vk::Format format) const {
+    const ::vk::FormatFeatureFlags needed = ::vk::FormatFeatureFlagBits::eSampledImage
+                                          | ::vk::FormatFeatureFlagBits::eSampledImageFilterLinear
+                                          | ::vk::FormatFeatureFlagBits::eTransferDst;
+    return (device.physical.getFormatProperties(format).optimalTilingFeatures & needed) == needed;
+}
+si::texture_region si::vk::texture_manager::add(std::string filepath) {
+    return add(decode_image(filepath, max_atlased));
+}
+std::uint32_t si::vk::texture_manager::add_streamed(std::string filepath) {
+    const std::uint32_t id = streams.size();
+    streams.push_back(stream { .region = placeholder, .arriving = std::nullopt, .uploaded = {} });
+    decoders.post([this, id, filepath = std::move(filepath)] {
+        try {
+            decoded_image image = decode_image(filepath, max_atlased);
+            std::lock_guard lock(decoded_mutex);
+            decoded.emplace_back(id, std::move(image));
+            if (decoded_notify) {
+                decoded_notify();
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("Couldn't load {}: {}", filepath, e.what());
+            std::lock_guard lock(decoded_mutex);
+            decoded.emplace_back(id, decoded_image { .format = {}, .width = 0, .height = 0, .bitmap = nullptr, .contents = {}, .levels = {} });
+            if (decoded_notify) {
+                decoded_notify();
+            }
+        }
+    });
+    return id;
+}
+si::texture_region si::vk::texture_manager::region(std::uint32_t id) const {
+    return streams[id].region;
+}
+bool si::vk::texture_manager::update() {
+    std::vector<std::pair<std::uint32_t, decoded_image>> arrived;
+    {
+        std::lock_guard lock(decoded_mutex);
+        std::swap(arrived, decoded);
+    }
+    for (auto& [id, image] : arrived) {
+        stream& s = streams[id];
+        if (image.level_count() == 0) {
+            s.resident = true; // failed; the placeholder stays
+            continue;
+        }
+        try {
+            s.arriving = add(image);
+            s.uploaded = latest;
+        } catch (const std::exception& e) {
+            spdlog::error("Couldn't upload streamed texture {}: {}", id, e.what());
+            s.resident = true;
+        }
+    }
+    // A new slot rather than rebinding the placeholder's, which frames in flight may be sampling
+    bool changed = false;
+    for (stream& s : streams) {
+        if (s.arriving && s.uploaded.ready()) {
+            s.region = *s.arriving;
+            s.arriving.reset();
+            s.resident = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+void si::vk::texture_manager::notify_decoded(std::function<void()> notify) {
+    std::lock_guard lock(decoded_mutex);
+    decoded_notify = std::move(notify);
+    if (decoded_notify && !decoded.empty()) {
+        decoded_notify();
+    }
+}
+bool si::vk::texture_manager::streaming() const {
+    return std::any_of(streams.begin(), streams.end(), [](const stream& s) { return !s.resident; });
+}
+si::vk::coverage_page si::vk::texture_manager::add_coverage(::vk::Extent2D extent) {
+    const ::vk::ComponentMapping coverage_as_alpha {
+        .r = ::vk::ComponentSwizzle::eOne,
+        .g = ::vk::ComponentSwizzle::eOne,
+        .b = ::vk::ComponentSwizzle::eOne,
+        .a = ::vk::ComponentSwizzle::eR
+    };
+    texture tex = make_texture(extent, ::vk::ImageLayout::eGeneral, ::vk::Format::eR8Unorm, coverage_as_alpha);
+    const coverage_page page { bind(tex, ::vk::ImageLayout::eGeneral), *tex.image };
+    singles.push_back(std::move(tex));
+    return page;
+}
+si::vk::upload si::vk::texture_manager::ready() const {
+    return latest;
+}
+::vk::DescriptorSetLayout si::vk::texture_manager::set_layout() const {
+    return *layout;
+}
+::vk::DescriptorSet si::vk::texture_manager::descriptor_set() const {
+    return set;
+}
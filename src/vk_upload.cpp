@@ -0,0 +1,253 @@
+#include <si/vk_upload.hpp>
+#include <si/vk_renderer.hpp>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+si::vk::upload::upload(uploader* owner, std::uint64_t value): owner(owner), value(value) {
+}
+bool si::vk::upload::ready() const {
+    return !owner || owner->collect() >= value;
+}
+void si::vk::upload::wait() const {
+    if (owner) {
+        owner->wait(value);
+    }
+}
+
+si::vk::uploader::uploader(gfx_device& device):
+    device(device),
+    command_pool(device.logical->createCommandPoolUnique({::vk::CommandPoolCreateFlagBits::eResetCommandBuffer, device.transfer_q_family_ix})),
+    // 16 bytes covers the texel size of every format we copy into images
+    ring_alignment(std::max<::vk::DeviceSize>(16, device.physical.getProperties().limits.optimalBufferCopyOffsetAlignment)) {
+    std::tie(ring, ring_memory) = device.make_buffer (
+        ring_capacity,
+        ::vk::BufferUsageFlagBits::eTransferSrc,
+        ::vk::SharingMode::eExclusive,
+        ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+}
+si::vk::uploader::~uploader() {
+    for (auto& batch : submitted) {
+        device.logical->waitForFences(*batch->fence, true, std::numeric_limits<std::uint64_t>::max());
+    }
+}
+si::vk::upload_batch& si::vk::uploader::current() {
+    if (!recording) {
+        if (spare.empty()) {
+            auto batch = std::make_unique<upload_batch>();
+            batch->cmd = std::move(device.logical->allocateCommandBuffersUnique (
+                ::vk::CommandBufferAllocateInfo {
+                    .commandPool = *command_pool,
+                    .level = ::vk::CommandBufferLevel::ePrimary,
+                    .commandBufferCount = 1
+                }
+            ).front());
+            batch->fence = device.logical->createFenceUnique({});
+            counters.objects_created += 2;
+            recording = std::move(batch);
+        } else {
+            recording = std::move(spare.back());
+            spare.pop_back();
+            recording->cmd->reset({});
+            device.logical->resetFences(*recording->fence);
+        }
+        recording->value = next_value++;
+        recording->cmd->begin(::vk::CommandBufferBeginInfo { .flags = ::vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    }
+    return *recording;
+}
+si::vk::upload si::vk::uploader::copy(::vk::Buffer src, ::vk::Buffer dst, ::vk::BufferCopy what) {
+    upload_batch& batch = current();
+    batch.cmd->copyBuffer(src, dst, what);
+    return upload(this, batch.value);
+}
+si::vk::upload si::vk::uploader::copy(::vk::Buffer src, ::vk::Image dst, ::vk::BufferImageCopy what, ::vk::ImageLayout dst_layout) {
+    upload_batch& batch = current();
+    batch.cmd->copyBufferToImage(src, dst, dst_layout, what);
+    return upload(this, batch.value);
+}
+si::vk::upload si::vk::uploader::copy(::vk::Buffer src, ::vk::Image dst, const std::vector<::vk::BufferImageCopy>& what, ::vk::ImageLayout dst_layout) {
+    upload_batch& batch = current();
+    batch.cmd->copyBufferToImage(src, dst, dst_layout, what);
+    return upload(this, batch.value);
+}
+si::vk::upload si::vk::uploader::transition(::vk::Image img, ::vk::ImageLayout from, ::vk::ImageLayout to, std::uint32_t levels) {
+    ::vk::AccessFlags src_access;
+    ::vk::AccessFlags dst_access;
+    ::vk::PipelineStageFlags src_stage;
+    ::vk::PipelineStageFlags dst_stage;
+    if (from == ::vk::ImageLayout::eUndefined && (to == ::vk::ImageLayout::eTransferDstOptimal || to == ::vk::ImageLayout::eGeneral)) {
+        src_stage = ::vk::PipelineStageFlagBits::eTopOfPipe;
+        dst_stage = ::vk::PipelineStageFlagBits::eTransfer;
+        dst_access = ::vk::AccessFlagBits::eTransferWrite;
+    } else if ((from == ::vk::ImageLayout::eTransferDstOptimal && to == ::vk::ImageLayout::eShaderReadOnlyOptimal)
+            || (from == ::vk::ImageLayout::eGeneral && to == ::vk::ImageLayout::eGeneral)) {
+        src_stage = ::vk::PipelineStageFlagBits::eTransfer;
+        src_access = ::vk::AccessFlagBits::eTransferWrite;
+        if (device.transfer_q_family_ix == device.graphics_q_family_ix) {
+            dst_stage = ::vk::PipelineStageFlagBits::eFragmentShader;
+            dst_access = ::vk::AccessFlagBits::eShaderRead;
+        } else {
+            // A transfer-only queue can't name the fragment stage. The batch
+            // signals a semaphore that the graphics submit sampling the image
+            // waits on at the fragment stage, which makes the writes visible.
+            dst_stage = ::vk::PipelineStageFlagBits::eBottomOfPipe;
+        }
+    } else {
+        throw std::runtime_error("Unsupported upload layout transition");
+    }
+    const auto barrier = ::vk::ImageMemoryBarrier {
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+        .oldLayout = from,
+        .newLayout = to,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = img,
+        .subresourceRange = ::vk::ImageSubresourceRange {
+            .aspectMask = ::vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = levels,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    upload_batch& batch = current();
+    batch.cmd->pipelineBarrier (
+        src_stage, dst_stage,
+        ::vk::DependencyFlags{},
+        0, nullptr,
+        0, nullptr,
+        1, &barrier
+    );
+    return upload(this, batch.value);
+}
+void si::vk::uploader::retire(::vk::UniqueBuffer buffer, allocation memory) {
+    upload_batch& batch = current();
+    batch.retired_buffers.push_back(std::move(buffer));
+    batch.retired_memories.push_back(std::move(memory));
+}
+std::optional<::vk::DeviceSize> si::vk::uploader::ring_take(::vk::DeviceSize size) {
+    if (ring_holders == 0) {
+        ring_head = ring_tail = 0;
+    }
+    const ::vk::DeviceSize start = (ring_head + ring_alignment - 1) / ring_alignment * ring_alignment;
+    const bool wrapped = ring_head < ring_tail || (ring_head == ring_tail && ring_holders != 0);
+    if (!wrapped) {
+        if (start + size <= ring_capacity) {
+            ring_head = start + size;
+            return start;
+        } else if (size <= ring_tail) {
+            ring_head = size;
+            return 0;
+        }
+    } else if (start + size <= ring_tail) {
+        ring_head = start + size;
+        return start;
+    }
+    return std::nullopt;
+}
+si::vk::staging_region si::vk::uploader::stage(::vk::DeviceSize size) {
+    if (size > ring_capacity / 2) {
+        auto [buffer, memory] = device.make_buffer (
+            size,
+            ::vk::BufferUsageFlagBits::eTransferSrc,
+            ::vk::SharingMode::eExclusive,
+            ::vk::MemoryPropertyFlagBits::eHostVisible | ::vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+        counters.oversized_uploads++;
+        counters.objects_created++;
+        staging_region region { *buffer, 0, size, memory.mapped() };
+        retire(std::move(buffer), std::move(memory));
+        return region;
+    }
+    std::optional<::vk::DeviceSize> offset = ring_take(size);
+    while (!offset) {
+        // Out of ring space: hand what we have to the GPU and wait for the oldest batch to free some.
+        counters.ring_stalls++;
+        flush();
+        wait(submitted.front()->value);
+        offset = ring_take(size);
+    }
+    upload_batch& batch = current();
+    if (!batch.ring_end) {
+        ring_holders++;
+    }
+    batch.ring_end = ring_head;
+    counters.ring_uploads++;
+    counters.ring_bytes += size;
+    return staging_region { *ring, *offset, size, ring_memory.mapped() + *offset };
+}
+const si::vk::upload_stats& si::vk::uploader::stats() const {
+    return counters;
+}
+void si::vk::uploader::flush() {
+    if (!recording) {
+        return;
+    }
+    recording->cmd->end();
+    ::vk::SubmitInfo submit {
+        0, nullptr,
+        nullptr,
+        1, &*recording->cmd,
+        0, nullptr
+    };
+    if (device.transfer_q_family_ix != device.graphics_q_family_ix) {
+        if (idle_semaphores.empty()) {
+            signalled.push_back(device.logical->createSemaphoreUnique({}));
+            counters.objects_created++;
+        } else {
+            signalled.push_back(std::move(idle_semaphores.back()));
+            idle_semaphores.pop_back();
+        }
+        submit.signalSemaphoreCount = 1;
+        submit.pSignalSemaphores = &*signalled.back();
+    }
+    device.transfer_q.submit(submit, *recording->fence);
+    submitted.push_back(std::move(recording));
+}
+std::uint64_t si::vk::uploader::collect() {
+    while (!submitted.empty() && device.logical->getFenceStatus(*submitted.front()->fence) == ::vk::Result::eSuccess) {
+        auto batch = std::move(submitted.front());
+        submitted.pop_front();
+        completed_value = batch->value;
+        if (batch->ring_end) {
+            ring_tail = *batch->ring_end;
+            ring_holders--;
+            batch->ring_end.reset();
+        }
+        batch->retired_buffers.clear();
+        batch->retired_memories.clear();
+        spare.push_back(std::move(batch));
+    }
+    return completed_value;
+}
+void si::vk::uploader::wait(std::uint64_t value) {
+    if (recording && recording->value <= value) {
+        flush();
+    }
+    for (auto& batch : submitted) {
+        if (batch->value > value) {
+            break;
+        }
+        device.logical->waitForFences(*batch->fence, true, std::numeric_limits<std::uint64_t>::max());
+    }
+    collect();
+}
+std::vector<::vk::Semaphore> si::vk::uploader::take_waits(std::uint64_t serial) {
+    std::vector<::vk::Semaphore> waits;
+    for (::vk::UniqueSemaphore& semaphore : signalled) {
+        waits.push_back(*semaphore);
+        awaited.emplace_back(serial, std::move(semaphore));
+    }
+    signalled.clear();
+    return waits;
+}
+void si::vk::uploader::collect_waits(std::uint64_t completed_serial) {
+    // A binary semaphore can only be signalled again once its wait has executed
+    while (!awaited.empty() && awaited.front().first <= completed_serial) {
+        idle_semaphores.push_back(std::move(awaited.front().second));
+        awaited.pop_front();
+    }
+}
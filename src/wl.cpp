@@ -5,8 +5,18 @@
 #include <si/wl/shm.hpp>
 #include <si/wl/seat.hpp>
 #include <si/wlp/xdg_shell.hpp>
-#include <si/vk_renderer.hpp>
+#include <si/vk_render_thread.hpp>
+#ifdef SI_SHM_SUPPORTED
+#include <si/sw_renderer.hpp>
+#endif
 #include <si/ui.hpp>
+#include <si/event_loop.hpp>
+#include <sys/epoll.h>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+#include <optional>
+#include <cerrno>
 #include <spdlog/spdlog.h>
 
 void si::wl_run(const ::si::window& win) {
@@ -39,34 +49,112 @@ void si::wl_run(const ::si::window& win) {
         }
     );
 
-    // Use vulkan renderer for now
-    si::vk::root vk;
-    auto r = vk.make_renderer(my_display, my_surface, win.width, win.height);
+    si::event_loop loop;
+    // Vulkan draws and presents on a thread of its own, so this one only
+    // dispatches events and sends it what they changed. Without a usable
+    // device, the software renderer draws into shm buffers on this thread.
+    std::optional<si::vk::root> vk;
+    std::optional<si::vk::render_thread> renderer;
+#ifdef SI_SHM_SUPPORTED
+    auto my_shm = my_registry.make<::wl::shm>("wl_shm");
+    std::optional<si::sw::renderer> software;
+#endif
+    try {
+        vk.emplace();
+        renderer.emplace(
+            vk->make_renderer(my_display, my_surface, win.width, win.height, win.presentation),
+            [&loop]() { loop.wake(); }
+        );
+    } catch (const std::exception& e) {
+#ifdef SI_SHM_SUPPORTED
+        spdlog::warn("Can't render with Vulkan, so drawing in software: {}", e.what());
+        vk.reset();
+        software.emplace(my_shm, win.width, win.height);
+#else
+        throw;
+#endif
+    }
+    si::vk::frame_snapshot next;
+    bool configured = false; // buffers can't be attached before the first configure is acked
     my_xdg_surface.on_configure.connect(
         [&](std::uint32_t serial) {
             spdlog::debug("Configuring...");
+            configured = true;
+            // A zero size leaves it to us, so the window keeps the one it has
             if (new_width != 0 && new_height != 0) {
-                r->resize(new_width, new_height);
-                my_xdg_surface.ack_configure(serial);
-                my_surface.commit();
+                next.extent = ::vk::Extent2D { static_cast<std::uint32_t>(new_width), static_cast<std::uint32_t>(new_height) };
             }
+            // Whatever presents acks too. With Vulkan that's the render
+            // thread, and a commit from here could latch half of its frame.
+            next.configure = [&my_xdg_surface, serial]() { my_xdg_surface.ack_configure(serial); };
         }
     );
-    
-    // Draw loop
-    boost::signals2::signal<void(std::chrono::milliseconds)> frame_request;
-    frame_request.connect (
-        [&](std::chrono::milliseconds now) {
-            spdlog::debug("Drawing...");
-            r->draw();
-            my_surface.frame(frame_request);
-            my_surface.commit();
+
+    const int display_fd = my_display.fd();
+    std::function<void(std::uint32_t)> on_display;
+    // Requests that don't fit in a full socket stay buffered until it drains,
+    // so writability is only watched for while some are left over
+    bool flush_blocked = false;
+    auto flush = [&]() {
+        const bool blocked = my_display.flush() < 0 && errno == EAGAIN;
+        if (blocked != flush_blocked) {
+            flush_blocked = blocked;
+            loop.watch(display_fd, blocked ? EPOLLIN | EPOLLOUT : EPOLLIN, on_display);
+        }
+    };
+    loop.before_wait.connect(
+        [&]() {
+            // Anything queued is dispatched before the read is prepared, or it
+            // would sit there until the next event arrives. The render thread's
+            // swapchain reads its own events alongside, on a queue of its own.
+            my_display.dispatch_pending();
+            while (!my_display.prepare_read()) {
+                my_display.dispatch_pending();
+            }
+            // Everything the handlers changed goes over as one snapshot. The
+            // render thread draws it as soon as it's free, so there's no
+            // frame callback to wait for here.
+            if (renderer) {
+                renderer->submit(std::exchange(next, si::vk::frame_snapshot {}));
+            }
+#ifdef SI_SHM_SUPPORTED
+            if (software && configured) {
+                si::vk::frame_snapshot changed = std::exchange(next, si::vk::frame_snapshot {});
+                if (changed.extent) {
+                    software->resize(changed.extent->width, changed.extent->height);
+                }
+                if (changed.configure) {
+                    changed.configure();
+                }
+                // With every buffer still on screen this draws nothing; the
+                // release is a display event, which brings the loop back here.
+                // An ack still needs a commit to take effect.
+                if (!software->draw(my_surface) && changed.configure) {
+                    my_surface.commit();
+                }
+            }
+#endif
+            flush();
         }
     );
-    // Not sure why initial draw is required...
-    r->draw();
-    my_surface.frame(frame_request);
-    my_surface.commit();
-    while (my_display.dispatch() != -1) {
-    }
+    loop.after_wait.connect(
+        [&]() {
+            if (loop.ready_events(display_fd) & EPOLLIN) {
+                my_display.read_events();
+            } else {
+                my_display.cancel_read();
+            }
+        }
+    );
+    on_display = [&](std::uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            throw std::runtime_error("Lost the connection to the display!");
+        }
+        if (events & EPOLLOUT) {
+            flush();
+        }
+        my_display.dispatch_pending();
+    };
+    loop.watch(display_fd, EPOLLIN, on_display);
+    loop.run();
 }
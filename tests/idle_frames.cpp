@@ -0,0 +1,55 @@
+#include <si/vk_render_thread.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+
+// A window nothing invalidates must not draw: once the first frames are up,
+// sitting idle for 10 s submits no frames at all. Then one invalidation
+// must draw again, so the count isn't zero just because drawing is stuck.
+namespace {
+    using namespace std::chrono_literals;
+
+    // Waits until frames stop being drawn for a while, or gives up
+    std::uint64_t settle(const si::vk::render_thread& r, std::chrono::milliseconds quiet, std::chrono::seconds limit) {
+        const auto give_up = std::chrono::steady_clock::now() + limit;
+        std::uint64_t frames = r.frames();
+        auto changed = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() < give_up) {
+            std::this_thread::sleep_for(10ms);
+            if (const std::uint64_t now = r.frames(); now != frames) {
+                frames = now;
+                changed = std::chrono::steady_clock::now();
+            } else if (std::chrono::steady_clock::now() - changed >= quiet) {
+                break;
+            }
+        }
+        return frames;
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    si::vk::root vk;
+    si::vk::render_thread r(vk.make_headless_renderer(640, 480), []() {});
+    // The first frame, and one more when the streamed backdrop swaps in
+    const std::uint64_t started = settle(r, 1s, 10s);
+    if (started == 0) {
+        fmt::print("Nothing was drawn to start with\n");
+        return 1;
+    }
+    std::this_thread::sleep_for(10s);
+    r.flush();
+    if (const std::uint64_t idle = r.frames() - started; idle != 0) {
+        fmt::print("{} frames were drawn in 10 s idle\n", idle);
+        return 1;
+    }
+    r.submit(si::vk::frame_snapshot { .extent = {}, .scene = {}, .invalidate = true });
+    if (settle(r, 500ms, 5s) == started) {
+        fmt::print("Invalidating didn't draw a frame\n");
+        return 1;
+    }
+    fmt::print("0 frames in 10 s idle\n");
+    return 0;
+}
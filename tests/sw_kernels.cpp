@@ -0,0 +1,97 @@
+#include <si/sw_raster.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Every SIMD kernel this CPU runs must give exactly what the scalar ones do,
+// as span_kernels promises, over spans of every length around the vector
+// widths, at every alignment, with opaque, clear and translucent colours.
+namespace {
+    constexpr std::size_t max_span = 70;
+    constexpr std::size_t max_misalignment = 8;
+    constexpr int colours_per_span = 16;
+
+    std::uint32_t random_pixel(std::mt19937& random) {
+        std::uint32_t argb = random();
+        // Opaque and clear are where the kernels take shortcuts
+        switch (random() % 4) {
+            case 0: argb |= 0xff000000; break;
+            case 1: argb &= 0x00ffffff; break;
+        }
+        return si::sw::premultiply(argb);
+    }
+    std::uint8_t random_coverage(std::mt19937& random) {
+        switch (random() % 4) {
+            case 0: return 0;
+            case 1: return 0xff;
+            default: return static_cast<std::uint8_t>(random());
+        }
+    }
+
+    struct span {
+        std::vector<std::uint32_t> dst;
+        std::vector<std::uint32_t> src;
+        std::vector<std::uint8_t> coverage;
+    };
+    span random_span(std::mt19937& random) {
+        span s { std::vector<std::uint32_t>(max_misalignment + max_span), std::vector<std::uint32_t>(max_misalignment + max_span), std::vector<std::uint8_t>(max_misalignment + max_span) };
+        std::generate(s.dst.begin(), s.dst.end(), [&]() { return random_pixel(random); });
+        std::generate(s.src.begin(), s.src.end(), [&]() { return random_pixel(random); });
+        std::generate(s.coverage.begin(), s.coverage.end(), [&]() { return random_coverage(random); });
+        return s;
+    }
+
+    // Runs op over the span with the scalar kernels and with k, and reports any pixel that differs
+    template <typename Op>
+    int compare(const si::sw::span_kernels& k, const char* kernel, const span& s, std::size_t at, std::size_t n, Op&& op) {
+        std::vector<std::uint32_t> expected = s.dst;
+        std::vector<std::uint32_t> actual = s.dst;
+        op(si::sw::span_kernels::scalar, expected.data() + at);
+        op(k, actual.data() + at);
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            if (expected[i] != actual[i]) {
+                fmt::print (
+                    "{} {}: pixel {} of a span of {} at {} is {:08x}, not {:08x}\n",
+                    k.name, kernel, i, n, at, actual[i], expected[i]
+                );
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int main() {
+    std::mt19937 random(1);
+    int failures = 0;
+    for (const si::sw::span_kernels* k : si::sw::span_kernels::supported()) {
+        if (k == &si::sw::span_kernels::scalar) {
+            continue;
+        }
+        const int failed_before = failures;
+        for (std::size_t n = 0; n <= max_span; n++) {
+            for (std::size_t at = 0; at < max_misalignment; at++) {
+                const span s = random_span(random);
+                for (int i = 0; i < colours_per_span; i++) {
+                    const std::uint32_t colour = random_pixel(random);
+                    failures += compare(*k, "fill", s, at, n, [&](const si::sw::span_kernels& kernels, std::uint32_t* dst) {
+                        kernels.fill(dst, n, colour);
+                    });
+                    failures += compare(*k, "mask", s, at, n, [&](const si::sw::span_kernels& kernels, std::uint32_t* dst) {
+                        kernels.mask(dst, s.coverage.data() + at, n, colour);
+                    });
+                }
+                failures += compare(*k, "blend", s, at, n, [&](const si::sw::span_kernels& kernels, std::uint32_t* dst) {
+                    kernels.blend(dst, s.src.data() + at, n);
+                });
+            }
+        }
+        if (failures == failed_before) {
+            fmt::print("{} matches scalar\n", k->name);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+import argparse
+import struct
+
+arg_parser = argparse.ArgumentParser(description="Generate a .hpp embedding a SPIR-V module as a constexpr array")
+arg_parser.add_argument("input", metavar="infile", type=argparse.FileType('rb'), help="path to compiled SPIR-V module")
+arg_parser.add_argument("output", metavar="outfile", type=argparse.FileType('w'), nargs="?", default="-", help="destination path of generated c++ header (default: print to stdout)")
+arg_parser.add_argument("--name", required=True, help="name of the array in namespace si::vk::spirv")
+args = arg_parser.parse_args()
+
+code = args.input.read()
+if len(code) % 4 != 0:
+    raise SystemExit(f"{args.input.name}: code size must be multiple of 4")
+words = struct.unpack(f"<{len(code) // 4}I", code)
+if not words or words[0] != 0x07230203:
+    raise SystemExit(f"{args.input.name}: not a SPIR-V module")
+
+guard = f"SI_SPIRV_{args.name.upper()}_HPP_INCLUDED"
+o = lambda s: args.output.write(s)
+o(f"// Generated by spirv-embed.py from {args.input.name}. Do not edit.\n")
+o(f"#ifndef {guard}\n")
+o(f"#define {guard}\n\n")
+o( "#include <cstdint>\n\n")
+o( "namespace si::vk::spirv {\n")
+o(f"    inline constexpr std::uint32_t {args.name}[] = " + "{\n")
+for i in range(0, len(words), 8):
+    o("        " + ", ".join(f"0x{w:08x}" for w in words[i:i + 8]) + ",\n")
+o( "    };\n")
+o( "}\n\n")
+o( "#endif\n")